@@ -0,0 +1,51 @@
+#ifndef ARENA_HPP
+#define ARENA_HPP
+
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+#define CACHE_LINE 64
+
+// Bump allocator backing all per-run simulator state. Every block is
+// cache-line aligned and the whole arena is released in one shot.
+// With base == NULL arena_alloc only measures, so a layout routine can
+// run once to size the arena and again to carve it.
+typedef struct _arena_t
+{
+    char*  base = NULL;
+    size_t size = 0;    // capacity in bytes
+    size_t used = 0;
+} arena_t;
+
+inline void* arena_alloc(arena_t* a, size_t bytes)
+{
+    size_t off = (a->used + CACHE_LINE - 1) & ~(size_t)(CACHE_LINE - 1);
+    a->used = off + bytes;
+    return a->base ? a->base + off : NULL;
+}
+
+inline void arena_release(arena_t* a)
+{
+    free(a->base);
+    a->base = NULL;
+    a->size = 0;
+    a->used = 0;
+}
+
+// Make room for `bytes`, keeping the current block if it is big enough
+inline void arena_reserve(arena_t* a, size_t bytes)
+{
+    if (bytes > a->size)
+    {
+        void* p = NULL;
+        arena_release(a);
+        if (posix_memalign(&p, CACHE_LINE, bytes) != 0)
+            throw std::bad_alloc();
+        a->base = (char*)p;
+        a->size = bytes;
+    }
+    a->used = 0;
+}
+
+#endif /* ARENA_HPP */
@@ -0,0 +1,99 @@
+#ifndef BPRED_HPP
+#define BPRED_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+#define BP_NONE     0
+#define BP_BIMODAL  1
+#define BP_GSHARE   2
+
+#define DEFAULT_BP_BITS     12
+#define DEFAULT_BP_PENALTY  3
+#define MAX_BP_BITS         24
+#define MAX_BP_PENALTY      1000000
+
+// Table-based branch predictor of 2-bit saturating counters packed 32 to
+// a 64-bit word; the default 4096-entry table is 1 KB. Bimodal indexes by
+// PC, gshare by PC xor global history. The trace does not mark branches,
+// so after the counters the table holds one bit per PC slot, set once the
+// instruction there has been seen taken. Only those known branches are
+// predicted and shift the global history; anything else falls through.
+typedef struct _bpred_t
+{
+    int       type    = BP_NONE;
+    int       bits    = DEFAULT_BP_BITS;     // log2 of the counter count
+    int       penalty = DEFAULT_BP_PENALTY;  // fetch stall cycles per mispredict
+    uint64_t* table   = NULL;
+    uint32_t  ghr     = 0;
+} bpred_t;
+
+inline size_t bp_counter_words(const bpred_t* b)
+{
+    return ((size_t(1) << b->bits) + 31) / 32;
+}
+
+// Whole table: counters, then branch bits
+inline size_t bp_words(const bpred_t* b)
+{
+    return bp_counter_words(b) + ((size_t(1) << b->bits) + 63) / 64;
+}
+
+inline void bp_clear(bpred_t* b)
+{
+    // every counter weakly not-taken, no branch known
+    for (size_t i = 0; i < bp_counter_words(b); i++)
+        b->table[i] = 0x5555555555555555ull;
+    for (size_t i = bp_counter_words(b); i < bp_words(b); i++)
+        b->table[i] = 0;
+    b->ghr = 0;
+}
+
+inline uint64_t* bp_branch_word(const bpred_t* b, uint32_t pc, int* bit)
+{
+    uint32_t i = (pc >> 2) & ((1u << b->bits) - 1);
+    *bit = i & 63;
+    return &b->table[bp_counter_words(b) + (i >> 6)];
+}
+
+inline bool bp_is_branch(const bpred_t* b, uint32_t pc)
+{
+    int bit;
+    return (*bp_branch_word(b, pc, &bit) >> bit) & 1;
+}
+
+inline void bp_mark_branch(bpred_t* b, uint32_t pc)
+{
+    int bit;
+    *bp_branch_word(b, pc, &bit) |= 1ull << bit;
+}
+
+inline uint32_t bp_index(const bpred_t* b, uint32_t pc)
+{
+    uint32_t i = pc >> 2;
+    if (b->type == BP_GSHARE)
+        i ^= b->ghr;
+    return i & ((1u << b->bits) - 1);
+}
+
+inline bool bp_predict(const bpred_t* b, uint32_t pc)
+{
+    uint32_t i = bp_index(b, pc);
+    return (b->table[i >> 5] >> ((i & 31) * 2)) & 2;
+}
+
+inline void bp_update(bpred_t* b, uint32_t pc, bool taken)
+{
+    uint32_t  i  = bp_index(b, pc);
+    uint64_t* w  = &b->table[i >> 5];
+    int       sh = (i & 31) * 2;
+    uint64_t  c  = (*w >> sh) & 3;
+    if (taken && (c < 3))
+        c++;
+    else if (!taken && (c > 0))
+        c--;
+    *w = (*w & ~(3ull << sh)) | (c << sh);
+    b->ghr = (b->ghr << 1) | taken;
+}
+
+#endif /* BPRED_HPP */
@@ -0,0 +1,211 @@
+#include "checkpoint.hpp"
+#include <algorithm>
+#include <cstring>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define CKPT_REC_MAGIC  "CKPR"
+
+static bool put(FILE* f, const void* p, size_t n)
+{
+    return fwrite(p, 1, n, f) == n;
+}
+
+static bool get(FILE* f, void* p, size_t n)
+{
+    return fread(p, 1, n, f) == n;
+}
+
+static bool put_str(FILE* f, const std::string& s)
+{
+    uint64_t n = s.size();
+    return put(f, &n, sizeof(n)) && put(f, s.data(), n);
+}
+
+// Bytes from the read position to the end of the file; a length read
+// back that is larger than this is a torn or corrupt record
+static uint64_t left(FILE* f)
+{
+    struct stat st;
+    off_t at = ftello(f);
+    if ((at < 0) || fstat(fileno(f), &st) || (st.st_size < at))
+        return 0;
+    return st.st_size - at;
+}
+
+static bool get_str(FILE* f, std::string* s)
+{
+    uint64_t n;
+    if (!get(f, &n, sizeof(n)) || (n > left(f)))
+        return false;
+    s->resize(n);
+    return (n == 0) || get(f, &(*s)[0], n);
+}
+
+// Runs the prefix hash over trace records [from, to), noting block hashes
+static uint64_t advance(const trace_t* t, uint64_t h, uint64_t from, uint64_t to, std::vector<uint64_t>* blocks)
+{
+    for (uint64_t i = from; i < to; i++)
+    {
+        h = trace_hash(h, &t->rec[i]);
+        if ((i + 1) % CKPT_HASH_BLOCK == 0)
+            blocks->push_back(h);
+    }
+    return h;
+}
+
+//
+// ckpt_open
+//
+//  Opens an existing checkpoint file for resuming. False if there is
+//  none or it was recorded with another configuration; either way the
+//  file is rewritten by ckpt_start_writing.
+//
+bool ckpt_open(checkpointer_t* c, const char* path, const ckpt_config_t* config, trace_t* t)
+{
+    char magic[8];
+    ckpt_config_t saved;
+    c->path    = path;
+    c->config  = *config;
+    c->trace   = t;
+    c->file    = fopen(path, "rb");
+    if (c->file == NULL)
+        return false;
+    if (!get(c->file, magic, sizeof(magic)) || memcmp(magic, CKPT_MAGIC, sizeof(magic)) ||
+        !get(c->file, &saved, sizeof(saved)) || memcmp(&saved, config, sizeof(saved)))
+    {
+        fprintf(stderr, "checkpoint: %s is for another configuration, starting over\n", path);
+        fclose(c->file);
+        c->file = NULL;
+        return false;
+    }
+    c->valid_end = ftell(c->file);
+    return true;
+}
+
+//
+// ckpt_next
+//
+//  Reads the next record. True if it can be resumed from: the trace
+//  records it had fetched are the same in the current trace. Records are
+//  in cycle order, so the first one that fails ends the search.
+//
+bool ckpt_next(checkpointer_t* c, ckpt_rec_t* rec)
+{
+    char     magic[4];
+    uint64_t n;
+    FILE*    f = c->file;
+    if (f == NULL)
+        return false;
+    if (!get(f, magic, sizeof(magic)) || memcmp(magic, CKPT_REC_MAGIC, sizeof(magic)) ||
+        !get(f, &rec->clk, sizeof(rec->clk)) || !get(f, &rec->consumed, sizeof(rec->consumed)) ||
+        !get(f, &rec->at_end, sizeof(rec->at_end)) || !get(f, &rec->end_ret, sizeof(rec->end_ret)) ||
+        !get(f, &rec->hash, sizeof(rec->hash)) || !get(f, &rec->disp_first, sizeof(rec->disp_first)) ||
+        !get(f, &n, sizeof(n)) || (n > rec->consumed / CKPT_HASH_BLOCK + 1) ||
+        (n > left(f) / sizeof(uint64_t)))
+        return false;
+    rec->blocks.resize(n);
+    if ((n && !get(f, &rec->blocks[0], n * sizeof(uint64_t))) ||
+        !get_str(f, &rec->rob) || !get_str(f, &rec->disp) || !get_str(f, &rec->log) || !get_str(f, &rec->state))
+        return false;
+
+    // how far the current trace agrees with the recorded one
+    std::vector<uint64_t> blocks;
+    const trace_t* t = c->trace;
+    uint64_t upto = std::min<uint64_t>(rec->consumed, t->rec.size());
+    uint64_t h    = advance(t, c->hash, c->hashed, upto, &blocks);
+    size_t   i;
+    for (i = 0; (i < blocks.size()) && (i < rec->blocks.size()) && (blocks[i] == rec->blocks[i]); i++)
+        c->matched = (c->hashed / CKPT_HASH_BLOCK + i + 1) * CKPT_HASH_BLOCK;
+
+    if ((rec->consumed > t->rec.size()) || (h != rec->hash))
+        return false;
+    if (rec->at_end && ((t->rec.size() != rec->consumed) || (t->end_ret != rec->end_ret)))
+        return false;
+
+    c->hash      = h;
+    c->hashed    = rec->consumed;
+    c->matched   = std::max(c->matched, rec->consumed);
+    c->valid_end = ftell(f);
+    c->records++;
+    return true;
+}
+
+//
+// ckpt_start_writing
+//
+//  Drops every record after the last usable one and appends from there.
+//
+bool ckpt_start_writing(checkpointer_t* c)
+{
+    if (c->file)
+        fclose(c->file);
+    if (c->records > 0)
+    {
+        if (truncate(c->path, c->valid_end) != 0)
+            return false;
+        c->file = fopen(c->path, "r+b");
+        if (c->file && (fseek(c->file, 0, SEEK_END) != 0))
+        {
+            fclose(c->file);
+            c->file = NULL;
+        }
+    }
+    else
+    {
+        c->file = fopen(c->path, "wb");
+        if (c->file && !(put(c->file, CKPT_MAGIC, 8) && put(c->file, &c->config, sizeof(c->config))))
+        {
+            fclose(c->file);
+            c->file = NULL;
+        }
+    }
+    if (c->file == NULL)
+    {
+        fprintf(stderr, "checkpoint: failed to open %s for writing\n", c->path);
+        return false;
+    }
+    return true;
+}
+
+//
+// ckpt_fill_trace
+//
+//  Records how much of the trace has been fetched and its prefix hash.
+//
+void ckpt_fill_trace(checkpointer_t* c, ckpt_rec_t* rec)
+{
+    const trace_t* t = c->trace;
+    rec->consumed = t->pos;
+    rec->at_end   = t->at_end;
+    rec->end_ret  = t->end_ret;
+    rec->blocks.clear();
+    c->hash   = advance(t, c->hash, c->hashed, t->pos, &rec->blocks);
+    c->hashed = t->pos;
+    rec->hash = c->hash;
+}
+
+bool ckpt_write(checkpointer_t* c, const ckpt_rec_t* rec)
+{
+    FILE*    f = c->file;
+    uint64_t n = rec->blocks.size();
+    bool ok = put(f, CKPT_REC_MAGIC, 4) &&
+              put(f, &rec->clk, sizeof(rec->clk)) && put(f, &rec->consumed, sizeof(rec->consumed)) &&
+              put(f, &rec->at_end, sizeof(rec->at_end)) && put(f, &rec->end_ret, sizeof(rec->end_ret)) &&
+              put(f, &rec->hash, sizeof(rec->hash)) && put(f, &rec->disp_first, sizeof(rec->disp_first)) &&
+              put(f, &n, sizeof(n)) && (!n || put(f, &rec->blocks[0], n * sizeof(uint64_t))) &&
+              put_str(f, rec->rob) && put_str(f, rec->disp) && put_str(f, rec->log) && put_str(f, rec->state) &&
+              (fflush(f) == 0);
+    if (!ok)
+        fprintf(stderr, "checkpoint: write to %s failed\n", c->path);
+    else
+        c->records++;
+    return ok;
+}
+
+void ckpt_close(checkpointer_t* c)
+{
+    if (c->file)
+        fclose(c->file);
+    c->file = NULL;
+}
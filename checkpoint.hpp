@@ -0,0 +1,67 @@
+#ifndef CHECKPOINT_HPP
+#define CHECKPOINT_HPP
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "trace.hpp"
+
+#define CKPT_MAGIC              "PSIMCKP2"
+#define CKPT_HASH_BLOCK         256     // trace records per stored prefix hash
+#define DEFAULT_CKPT_INTERVAL   10000   // cycles between checkpoints
+
+// Machine configuration a checkpoint file was recorded with
+typedef struct _ckpt_config_t
+{
+    int32_t r, k0, k1, k2, f;
+    int32_t latency[3];
+    int32_t pipelined[3];
+    int32_t bp_type, bp_bits, bp_penalty;
+} ckpt_config_t;
+
+// One checkpoint, taken at a cycle boundary. The reorder buffer, the
+// dispatch queue and the log only ever grow at one end, so a record holds
+// just what they gained since the previous record; `state` is a snapshot
+// of everything else.
+typedef struct _ckpt_rec_t
+{
+    int32_t  clk         = 0;   // next cycle to run
+    uint64_t consumed    = 0;   // trace records fetched
+    int32_t  at_end      = 0;   // fetch asked for a record past the last one
+    int32_t  end_ret     = 0;
+    uint64_t hash        = 0;   // trace_hash over the consumed records
+    uint64_t disp_first  = 0;   // dispatch stream index of the queue head
+    std::vector<uint64_t> blocks;   // prefix hash at each CKPT_HASH_BLOCK boundary since the last record
+    std::string rob;                // reorder buffer entries appended
+    std::string disp;               // dispatch queue entries appended and still queued
+                                    // (stream index max(disp_first, previous end) onwards)
+    std::string log;                // log bytes appended
+    std::string state;
+} ckpt_rec_t;
+
+typedef struct _checkpointer_t
+{
+    FILE*         file      = NULL;
+    const char*   path      = NULL;
+    unsigned long interval  = DEFAULT_CKPT_INTERVAL;
+    trace_t*      trace     = NULL;
+    ckpt_config_t config;
+    uint64_t      hash      = TRACE_HASH_INIT;  // over trace records [0, hashed)
+    uint64_t      hashed    = 0;
+    uint64_t      matched   = 0;    // trace records known to match the recorded run
+    long          valid_end = 0;    // file offset after the last usable record
+    unsigned long records   = 0;    // usable records in the file
+    uint64_t      rob_saved  = 0;   // stream entries / bytes already in the file
+    uint64_t      disp_saved = 0;
+    uint64_t      log_saved  = 0;
+} checkpointer_t;
+
+bool ckpt_open(checkpointer_t* c, const char* path, const ckpt_config_t* config, trace_t* t);
+bool ckpt_next(checkpointer_t* c, ckpt_rec_t* rec);
+bool ckpt_start_writing(checkpointer_t* c);
+void ckpt_fill_trace(checkpointer_t* c, ckpt_rec_t* rec);
+bool ckpt_write(checkpointer_t* c, const ckpt_rec_t* rec);
+void ckpt_close(checkpointer_t* c);
+
+#endif /* CHECKPOINT_HPP */
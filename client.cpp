@@ -0,0 +1,258 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#include <getopt.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define DEFAULT_SOCKET  "/tmp/procsim.sock"
+
+const char* sock_path = DEFAULT_SOCKET;
+int port = 0;
+
+void print_help_and_exit(void) {
+    printf("procsim_client [OPTIONS] [request...]\n");
+    printf("  -S path\tServer Unix domain socket (default %s)\n", DEFAULT_SOCKET);
+    printf("  -P port\tServer on 127.0.0.1:port instead\n");
+    printf("  -n jobs\tLoad test: send this many jobs and report throughput and latency\n");
+    printf("  -c conns\tConcurrent connections for the load test (default 1)\n");
+    printf("  -h\t\tThis helpful output\n");
+    printf("\n");
+    printf("Requests are JSON lines, from the arguments or else stdin; replies go\n");
+    printf("to stdout. A load test cycles through the requests.\n");
+    exit(0);
+}
+
+static int connect_server(void)
+{
+    int fd;
+    if (port)
+    {
+        sockaddr_in a;
+        memset(&a, 0, sizeof(a));
+        a.sin_family      = AF_INET;
+        a.sin_port        = htons(port);
+        a.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        if ((fd >= 0) && (connect(fd, (sockaddr*)&a, sizeof(a)) == 0))
+            return fd;
+    }
+    else
+    {
+        sockaddr_un a;
+        memset(&a, 0, sizeof(a));
+        a.sun_family = AF_UNIX;
+        strncpy(a.sun_path, sock_path, sizeof(a.sun_path) - 1);
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if ((fd >= 0) && (connect(fd, (sockaddr*)&a, sizeof(a)) == 0))
+            return fd;
+    }
+    if (fd >= 0)
+        close(fd);
+    return -1;
+}
+
+//
+// call
+//
+//  Sends one request and waits for its reply line. Bytes read past the
+//  reply stay in *in for the next call.
+//
+static bool call(int fd, const std::string& req, std::string* in, std::string* reply)
+{
+    std::string line = req + "\n";
+    size_t off = 0;
+    while (off < line.size())
+    {
+        ssize_t n = write(fd, line.data() + off, line.size() - off);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        off += n;
+    }
+    size_t nl;
+    while ((nl = in->find('\n')) == std::string::npos)
+    {
+        char buf[4096];
+        ssize_t n = read(fd, buf, sizeof(buf));
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        in->append(buf, n);
+    }
+    *reply = in->substr(0, nl);
+    in->erase(0, nl + 1);
+    return true;
+}
+
+static double percentile(const std::vector<double>& sorted, double p)
+{
+    if (sorted.empty())
+        return 0.0;
+    size_t i = (size_t)(p / 100.0 * (sorted.size() - 1) + 0.5);
+    return sorted[std::min(i, sorted.size() - 1)];
+}
+
+//
+// load_test
+//
+//  Each connection sends jobs back to back, taking the next job number
+//  from a shared counter, and records the round trip of every reply.
+//  Every reply to a request must carry the same statistics as the first,
+//  whichever worker ran it and whatever ran there before.
+//
+static int load_test(const std::vector<std::string>& reqs, long jobs, int conns)
+{
+    std::atomic<long> next(0);
+    std::atomic<long> failed(0);
+    std::atomic<long> differed(0);
+    std::vector<std::string> first(reqs.size());
+    std::mutex first_lock;
+    std::vector<std::vector<double> > lat(conns);
+    std::vector<std::thread> threads;
+
+    auto start = std::chrono::steady_clock::now();
+    for (int c = 0; c < conns; c++)
+        threads.emplace_back([&, c]() {
+            int fd = connect_server();
+            std::string in;
+            std::string reply;
+            if (fd < 0)
+            {
+                perror("connect");
+                failed++;
+                return;
+            }
+            for (long j; (j = next++) < jobs; )
+            {
+                auto t0 = std::chrono::steady_clock::now();
+                if (!call(fd, reqs[j % reqs.size()], &in, &reply))
+                {
+                    failed += jobs - j;
+                    break;
+                }
+                lat[c].push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count());
+                if (reply.find("\"ok\":true") == std::string::npos)
+                {
+                    fprintf(stderr, "%s\n", reply.c_str());
+                    failed++;
+                    continue;
+                }
+                std::string stats = reply.substr(0, reply.find(",\"run_us\""));
+                std::lock_guard<std::mutex> hold(first_lock);
+                std::string& f = first[j % reqs.size()];
+                if (f.empty())
+                    f = stats;
+                else if (f != stats)
+                {
+                    fprintf(stderr, "Reply differs from an earlier one to the same request:\n%s\n%s\n",
+                            f.c_str(), stats.c_str());
+                    differed++;
+                }
+            }
+            close(fd);
+        });
+    for (auto& t : threads)
+        t.join();
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::vector<double> all;
+    for (auto& l : lat)
+        all.insert(all.end(), l.begin(), l.end());
+    std::sort(all.begin(), all.end());
+    double sum = 0;
+    for (double l : all)
+        sum += l;
+
+    printf("Jobs: %zu done, %ld failed, %ld inconsistent, %d connection%s\n", all.size(), (long)failed,
+           (long)differed, conns, (conns == 1) ? "" : "s");
+    printf("Throughput: %.1f jobs/s over %.3f s\n", secs > 0 ? all.size() / secs : 0.0, secs);
+    printf("Latency (ms): mean %.3f p50 %.3f p90 %.3f p99 %.3f max %.3f\n",
+           all.empty() ? 0.0 : sum / all.size(), percentile(all, 50), percentile(all, 90),
+           percentile(all, 99), all.empty() ? 0.0 : all.back());
+    return (failed || differed) ? 1 : 0;
+}
+
+int main(int argc, char* argv[]) {
+    int opt;
+    long jobs = 0;
+    int conns = 1;
+
+    while(-1 != (opt = getopt(argc, argv, "S:P:n:c:h"))) {
+        switch(opt) {
+        case 'S':
+            sock_path = optarg;
+            break;
+        case 'P':
+            port = atoi(optarg);
+            break;
+        case 'n':
+            jobs = atol(optarg);
+            break;
+        case 'c':
+            conns = atoi(optarg);
+            if (conns < 1)
+            {
+                fprintf(stderr, "Connections must be at least 1\n");
+                print_help_and_exit();
+            }
+            break;
+        case 'h':
+            /* Fall through */
+        default:
+            print_help_and_exit();
+            break;
+        }
+    }
+
+    std::vector<std::string> reqs(argv + optind, argv + argc);
+    if (reqs.empty())
+    {
+        char line[4096];
+        while (fgets(line, sizeof(line), stdin))
+        {
+            std::string s(line);
+            s.erase(s.find_last_not_of("\r\n") + 1);
+            if (!s.empty())
+                reqs.push_back(s);
+        }
+    }
+    if (reqs.empty())
+        print_help_and_exit();
+
+    if (jobs > 0)
+        return load_test(reqs, jobs, conns);
+
+    int fd = connect_server();
+    if (fd < 0)
+    {
+        perror("connect");
+        return 1;
+    }
+    std::string in;
+    std::string reply;
+    for (auto& r : reqs)
+    {
+        if (!call(fd, r, &in, &reply))
+        {
+            fprintf(stderr, "Connection closed by server\n");
+            return 1;
+        }
+        printf("%s\n", reply.c_str());
+    }
+    close(fd);
+    return 0;
+}
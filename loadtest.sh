@@ -0,0 +1,39 @@
+#!/bin/sh
+#
+# loadtest.sh
+#
+#  Starts procsim_server on a private socket, drives it with procsim_client
+#  and reports jobs per second and latency percentiles. Results are checked
+#  first: servercheck.sh compares a mixed job stream on one worker against
+#  procsim, and the client fails if repeats of a request disagree.
+#
+#  usage: loadtest.sh [jobs] [connections] [workers] [traces...]
+#
+JOBS=${1:-200}
+WORKERS=${3:-$(nproc)}
+CONNS=${2:-$WORKERS}
+[ $# -gt 3 ] && shift 3 || set -- traces/*.trace
+SOCK=/tmp/procsim.$$.sock
+
+./servercheck.sh "$@" || exit 1
+
+./procsim_server -S $SOCK -w $WORKERS "$@" &
+SERVER=$!
+trap 'kill $SERVER 2>/dev/null; wait $SERVER 2>/dev/null' EXIT
+
+# wait for the traces to load
+while [ ! -S $SOCK ]; do
+    kill -0 $SERVER 2>/dev/null || exit 1
+    sleep 0.1
+done
+
+# one request per trace, with and without a predictor
+REQS=
+for t in "$@"; do
+    id=$(basename $t .trace)
+    REQS="$REQS{\"trace\":\"$id\",\"r\":8,\"k0\":1,\"k1\":2,\"k2\":3,\"f\":4}
+{\"trace\":\"$id\",\"r\":2,\"f\":8,\"bp\":\"gshare\"}
+"
+done
+
+printf "%s" "$REQS" | ./procsim_client -S $SOCK -n $JOBS -c $CONNS
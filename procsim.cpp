@@ -2,13 +2,15 @@
 #include <iostream>
 #include <fstream>
 #include <climits>
+#include <cstring>
 
 using namespace std;
 
 // Globals
 procsim* p_proccessor;
-unsigned long fired_instructions;
-unsigned long retired_instructions;
+verifier_t* p_verifier = NULL;
+checkpointer_t* p_ckpt = NULL;
+ckpt_config_t proc_config;
 ofstream logfile;
 string logfp = "procsim.log";
 
@@ -18,6 +20,14 @@ void procsim::fetch(int clk)
     {
         if (fetch_state->ready)
         {
+            // redirecting after a mispredicted branch
+            if (fetch_stall > 0)
+            {
+                fetch_stall--;
+                stall_ctrs.fetch_slots_lost += fetch_rate;
+                return;
+            }
+
             if (VERBOSE)
                 cout << "Fetched:" << endl;
             
@@ -27,7 +37,15 @@ void procsim::fetch(int clk)
             for (int i = 0; i < fetch_rate; i++)
             {
                 p_instr = new proc_inst_t; // allocate memory   
-                read_success = read_instruction(p_instr); // Read from file
+                if (have_pending)
+                {
+                    // already read as lookahead
+                    *p_instr = pending;
+                    read_success = pending_ok;
+                    have_pending = false;
+                }
+                else
+                    read_success = read_instruction(p_instr); // Read from file
 
                 // Tag instruction + timestamp (clock cycle)
                 p_instr->tag = tag_ctr;
@@ -35,6 +53,7 @@ void procsim::fetch(int clk)
 
                 // add to queue(fifo) to model i-cache - copies value
                 fetch_state->Q.push(*p_instr);
+                fetch_latch++;
 
                 delete p_instr; // free memory
 
@@ -60,6 +79,35 @@ void procsim::fetch(int clk)
 
                 if (read_success)
                     tag_ctr++; // increment counter
+
+                // Taken branches show up as the next address not following
+                // this one; a wrong prediction stalls fetch for the penalty.
+                // An instruction never seen taken is not known to be a
+                // branch, so it is predicted to fall through and leaves the
+                // counters and global history alone.
+                if ((bpred.type != BP_NONE) && read_success)
+                {
+                    uint32_t pc = fetch_state->Q.back().instruction_address;
+                    pending = null_inst;
+                    pending_ok = read_instruction(&pending);
+                    have_pending = true;
+                    bool taken = pending_ok && (pending.instruction_address != pc + 4);
+                    bool known = bp_is_branch(&bpred, pc);
+                    bool pred  = known && bp_predict(&bpred, pc);
+                    if (known || taken)
+                    {
+                        bp_mark_branch(&bpred, pc);
+                        bp_update(&bpred, pc, taken);
+                    }
+                    stall_ctrs.branches_taken += taken;
+                    if (pred != taken)
+                    {
+                        stall_ctrs.mispredicts++;
+                        stall_ctrs.fetch_slots_lost += fetch_rate - 1 - i;
+                        fetch_stall = bpred.penalty;
+                        break;
+                    }
+                }
             }
         }
     }
@@ -83,10 +131,14 @@ void procsim::dispatch(int clk)
             
             for (int i = 0; i < fetch_rate; i++)
             {
+                // fetch may deliver fewer than F while redirecting
+                if (fetch_state->Q.empty())
+                    break;
                 // Move F instr's from i-buffer (fetch) to instr (dispatch) queue
                 disp_state->Q.push(fetch_state->Q.front());
                 disp_state->Q.back().disp_cnt = clk_ctr;
                 fetch_state->Q.pop();
+                disp_pushed++;
 
                 if (VERBOSE)
                 {
@@ -106,6 +158,9 @@ void procsim::dispatch(int clk)
                     logfile << clk_ctr << "\t" << "DISPATCHED" << "\t" << disp_state->Q.back().tag << endl;
                 }
             }
+            // anything left over is picked up next cycle
+            if (!fetch_state->Q.empty())
+                fetch_latch++;
         }
         
     }
@@ -142,6 +197,7 @@ void procsim::schedule(int clk)
 
             // Load up to F instr's into reservation station
             int f = 0;
+            int want = std::min((int)disp_state->Q.size(), fetch_rate);
             for (int i = 0; i < res_st_state->max; i++)
             {
                 // look for first F available table entries
@@ -172,7 +228,8 @@ void procsim::schedule(int clk)
                     }
 
                     f++;
-                    if (f==fetch_rate) break;
+                    rs_latch++;
+                    if (f==want) break;
                 }
             // }
             // if (f==0)
@@ -180,6 +237,9 @@ void procsim::schedule(int clk)
             //     cout << "no room in res station clk " << clk_ctr << endl;
             // }
             }
+            // slots not filled for lack of a ready RS entry
+            stall_ctrs.sched_slots   += want;
+            stall_ctrs.sched_rs_full += (f < want) ? want - f : 0;
         }
     }
 
@@ -188,10 +248,17 @@ void procsim::schedule(int clk)
         // cout << clk << endl;
         // rename
         // Set any fu_type -1 -> 0
+        // (tracks whether this pass changed any RS entry; if not, the
+        // stage suspends until something else does)
+        bool changed = false;
         for (int i = 0; i < res_st_state->max; i++)
-            if (res_st_state->buffer[i].tag!=-1)
-                res_st_state->buffer[i].op_code = (res_st_state->buffer[i].op_code==-1) ? 0 : res_st_state->buffer[i].op_code;
+            if ((res_st_state->buffer[i].tag!=-1) && (res_st_state->buffer[i].op_code==-1))
+            {
+                res_st_state->buffer[i].op_code = 0;
+                changed = true;
+            }
                 
+#ifdef LEGACY_DEPS
         // Set dependency variables 
         int d1;
         int d2;
@@ -238,16 +305,18 @@ void procsim::schedule(int clk)
                 }
             }
             // Set latest dependency if found
-            if (rs1 > -1)
+            if ((rs1 > -1) && (res_st_state->buffer[j].dep_rs[0] != rs1))
             {
                 res_st_state->buffer[j].dep_rs[0] = rs1;
+                changed = true;
                 // cout << "dependency 1 set" << endl;
                 // print_instr(res_st_state->buffer[i]);
                 // print_instr(res_st_state->buffer[j]);
             }
-            if (rs2 > -1)
+            if ((rs2 > -1) && (res_st_state->buffer[j].dep_rs[1] != rs1))
             {
                 res_st_state->buffer[j].dep_rs[1] = rs1;
+                changed = true;
                 // cout << "dependency 2 set" << endl;
                 // print_instr(res_st_state->buffer[i]);
                 // print_instr(res_st_state->buffer[j]);
@@ -262,52 +331,234 @@ void procsim::schedule(int clk)
             r1 = res_st_state->buffer[i].dep_rs[0];
             r2 = res_st_state->buffer[i].dep_rs[0];
             // cout << "entry " << i << " tag " << res_st_state->buffer[i].tag << " dest " << dest_reg << " dep regs " << d1 << " " << d2 << endl;
+            // no producer: dep_rs[1] is only ever set alongside dep_rs[0],
+            // so there is nothing to clear (and buffer[-1] is off the arena)
+            if (r1==-1)
+                continue;
             if (res_st_state->buffer[r1].retire)
             {
                 // cout << "clk " << clk_ctr << endl;
                 // print_instr(res_st_state->buffer[i]);
                 res_st_state->buffer[i].dep_rs[0] = -1;
+                changed = true;
                 // print_instr(res_st_state->buffer[i]);
             }
-            if (res_st_state->buffer[r2].retire)
+            if (res_st_state->buffer[r2].retire && (res_st_state->buffer[i].dep_rs[1] != -1))
             {
                 // cout << "clk " << clk_ctr << endl;
                 // print_instr(res_st_state->buffer[i]);
                 res_st_state->buffer[i].dep_rs[1] = -1;
+                changed = true;
                 // print_instr(res_st_state->buffer[i]);
             }
         }
+#else
+        // Search for RAW hazards, then clear those whose producer retired
+        if (link_producers())
+            changed = true;
+        if (wake_consumers())
+            changed = true;
+#endif
 
         // mark indep. instrs to fire
         for (int k = 0; k<3; k++)
         {
+            stall_ctrs.fu_slots[k] += exec_state[k].max;
+            sched_idle.fu_slots[k] = exec_state[k].max;
             // check for any available units
             for (int u = 0; u < exec_state[k].max; u++)
             {
-                if (!exec_state[k].busy[u] || exec_state[k].unit[u].to_bus)
+                // room in the unit, or its head leaves for the bus next cycle
+                if ((exec_state[k].count[u] < exec_state[k].depth) || fu_head(&exec_state[k], u)->to_bus)
                 {
-                    // find first instr w/ no dependencies
+                    // find first instr w/ no dependencies; with other
+                    // timing the oldest, so past-the-end fetches refilling
+                    // low entries cannot starve the trace's instructions
+                    int pick = -1;
                     for (int i = 0; i < res_st_state->max; i++)
                     {
                         if ((res_st_state->buffer[i].op_code==k) && res_st_state->busy[i])
                         {
                             if ((!res_st_state->buffer[i].fire) && (res_st_state->buffer[i].dep_rs[0]==-1) && (res_st_state->buffer[i].dep_rs[1]==-1))
                             {
-                                // mark to fire
-                                res_st_state->buffer[i].fire = 1;
-                                fired_instructions++;
-                                // set target fu unit
-                                res_st_state->buffer[i].fu_unit = u;
-                                break;
+                                if ((pick == -1) || (res_st_state->buffer[i].tag < res_st_state->buffer[pick].tag))
+                                    pick = i;
+                                if (hold_bus)
+                                    break;
                             }
                         }
                     }
+                    if (pick != -1)
+                    {
+                        // mark to fire
+                        res_st_state->buffer[pick].fire = 1;
+                        fired_instructions++;
+                        stall_ctrs.issued[k]++;
+                        // set target fu unit
+                        res_st_state->buffer[pick].fu_unit = u;
+                        changed = true;
+                        fire_latch++;
+                    }
                 }
             }
         }
+
+        // classify entries left waiting this cycle
+        int k;
+        for (k = 0; k < 3; k++)
+        {
+            sched_idle.wait_dep[k] = 0;
+            sched_idle.wait_fu[k]  = 0;
+        }
+        for (int i = 0; i < res_st_state->max; i++)
+        {
+            k = res_st_state->buffer[i].op_code;
+            if (res_st_state->busy[i] && !res_st_state->buffer[i].fire && (k>=0) && (k<3))
+            {
+                if ((res_st_state->buffer[i].dep_rs[0]!=-1) || (res_st_state->buffer[i].dep_rs[1]!=-1))
+                    sched_idle.wait_dep[k]++;
+                else
+                    sched_idle.wait_fu[k]++;
+            }
+        }
+        for (k = 0; k < 3; k++)
+        {
+            stall_ctrs.wait_dep[k] += sched_idle.wait_dep[k];
+            stall_ctrs.wait_fu[k]  += sched_idle.wait_fu[k];
+        }
+        if (changed)
+            rs_latch++;
     }
 }
 
+//
+// link_producers
+//
+//  Points dep_rs of each RS entry at a producer found through the
+//  register scoreboard, in place of comparing every pair of entries.
+//  Gives the same links as the pairwise search: entries are visited in
+//  index order, a producer must sit at a lower index, write the source
+//  register, be older, not be retiring and have that dep_rs unset. The
+//  youngest such producer is taken only if it is younger than any taken
+//  for an earlier entry, and dep_rs[1] follows the dep_rs[0] producer.
+//  Returns true if any link changed.
+//
+bool procsim::link_producers()
+{
+    proc_inst_t* b = res_st_state->buffer;
+    int max = res_st_state->max;
+    int w   = sb_words;
+    bool changed = false;
+
+    memset(sb_other, 0, w * sizeof(uint64_t));
+    memset(sb_free[0], 0, w * sizeof(uint64_t));
+    memset(sb_free[1], 0, w * sizeof(uint64_t));
+    memset(sb_retired, 0, w * sizeof(uint64_t));
+    // every row may be read as a source's candidates, so none may keep
+    // bits from an earlier pass
+    memset(sb_prod, 0, SB_REGS * w * sizeof(uint64_t));
+    for (int i = 0; i < max; i++)
+    {
+        int dest = b[i].dest_reg;
+        if (b[i].dep_rs[0] == -1)
+            bits_set(sb_free[0], i);
+        if (b[i].dep_rs[1] == -1)
+            bits_set(sb_free[1], i);
+        if (b[i].retire)
+        {
+            // only retiring entries' waiter rows are read this pass
+            bits_set(sb_retired, i);
+            memset(&sb_waiters[i * w], 0, w * sizeof(uint64_t));
+        }
+        else if ((dest >= 0) && (dest < SB_REGS))
+            bits_set(&sb_prod[dest * w], i);
+        else if (dest != -1)
+            bits_set(sb_other, i);
+    }
+
+    int sup_tag[2] = {-1, -1};
+    int rs[2]      = {-1, -1};
+    for (int i = 0; i < max; i++)
+    {
+        for (int n = 0; n < 2; n++)
+        {
+            int src = b[i].src_reg[n];
+            bool own_row = (src >= 0) && (src < SB_REGS);
+            if (src == -1)
+                continue;
+            const uint64_t* cand = own_row ? &sb_prod[src * w] : sb_other;
+            // producers at indices below i
+            for (int x = 0; x <= (i >> 6); x++)
+            {
+                uint64_t m = cand[x] & sb_free[n][x];
+                if (x == (i >> 6))
+                    m &= (1ull << (i & 63)) - 1;
+                for (; m; m &= m - 1)
+                {
+                    int j = x*64 + __builtin_ctzll(m);
+                    if (!own_row && (b[j].dest_reg != src))
+                        continue;
+                    if ((b[i].tag > b[j].tag) && (b[j].tag > sup_tag[n]))
+                    {
+                        sup_tag[n] = b[j].tag;
+                        rs[n] = j;
+                    }
+                }
+            }
+        }
+        if ((rs[0] > -1) && (b[i].dep_rs[0] != rs[0]))
+        {
+            b[i].dep_rs[0] = rs[0];
+            bits_clear(sb_free[0], i);
+            changed = true;
+        }
+        if ((rs[1] > -1) && (b[i].dep_rs[1] != rs[0]))
+        {
+            b[i].dep_rs[1] = rs[0];
+            if (rs[0] == -1)
+                bits_set(sb_free[1], i);
+            else
+                bits_clear(sb_free[1], i);
+            changed = true;
+        }
+        if (b[i].dep_rs[0] != -1)
+            bits_set(&sb_waiters[b[i].dep_rs[0] * w], i);
+    }
+    return changed;
+}
+
+//
+// wake_consumers
+//
+//  Clears both dependencies of every entry whose dep_rs[0] producer is
+//  marked to retire. The entries to wake are the union of the retiring
+//  entries' waiter rows.
+//
+bool procsim::wake_consumers()
+{
+    proc_inst_t* b = res_st_state->buffer;
+    int w = sb_words;
+    bool changed = false;
+
+    memset(sb_woken, 0, w * sizeof(uint64_t));
+    for (int x = 0; x < w; x++)
+        for (uint64_t m = sb_retired[x]; m; m &= m - 1)
+        {
+            const uint64_t* row = &sb_waiters[(x*64 + __builtin_ctzll(m)) * w];
+            for (int y = 0; y < w; y++)
+                sb_woken[y] |= row[y];
+        }
+    for (int x = 0; x < w; x++)
+        for (uint64_t m = sb_woken[x]; m; m &= m - 1)
+        {
+            int i = x*64 + __builtin_ctzll(m);
+            b[i].dep_rs[0] = -1;
+            b[i].dep_rs[1] = -1;
+            changed = true;
+        }
+    return changed;
+}
+
 void procsim::execute(int clk)
 {
     if (clk==0)
@@ -315,6 +566,7 @@ void procsim::execute(int clk)
         // cout << "ex start" << endl;
         int k;
         int u;
+        exec_instr_t* slot = NULL;
         // Move/copy instructions that are marked to fire, into units
         for (int i = 0; i < res_st_state->max; i++)
         {
@@ -326,43 +578,55 @@ void procsim::execute(int clk)
                 u = res_st_state->buffer[i].fu_unit;
                 if ((k!=-1) && (u!=-1))
                 {
-                    exec_state[k].unit[u].tag = res_st_state->buffer[i].tag;
-                    exec_state[k].unit[u].res_st = i;
-                    exec_state[k].unit[u].dest_reg = res_st_state->buffer[i].dest_reg;
-                    exec_state[k].busy[u] = 1;
+                    // append to the unit's in-flight ring
+                    exec_state_t* e = &exec_state[k];
+                    slot = &e->unit[u*e->depth + (e->head[u] + e->count[u]) % e->depth];
+                    slot->tag = res_st_state->buffer[i].tag;
+                    slot->res_st = i;
+                    slot->dest_reg = res_st_state->buffer[i].dest_reg;
+                    slot->done = clk_ctr + e->latency - 1;
+                    e->count[u]++;
+                    e->busy[u] = 1;
+                    rs_latch++;
                     res_st_state->buffer[i].exec_cnt = clk_ctr;
+
+                    // post to the wheel bucket of its completion cycle
+                    int b = slot->done & (wheel_size - 1);
+                    fu_ref_t ref = {slot->tag, k, u};
+                    wheel[b*n_units + wheel_cnt[b]++] = ref;
                 }
 
                 if (LOG)
                 {
                     if (!logfile.is_open())
                         logfile.open(logfp);
-                    logfile << clk_ctr << "\t" << "EXECUTED" << "\t" << exec_state[k].unit[u].tag << endl;
+                    logfile << clk_ctr << "\t" << "EXECUTED" << "\t" << slot->tag << endl;
                 }
             }
         }
     }
     if (clk==1)
     {
+        // ops completing this cycle become bus candidates if they head
+        // their unit; ones queued behind a head are added when it leaves
+        int b = clk_ctr & (wheel_size - 1);
+        fu_ref_t ref;
+        for (int n = 0; n < wheel_cnt[b]; n++)
+        {
+            ref = wheel[b*n_units + n];
+            if (fu_head(&exec_state[ref.k], ref.u)->done == clk_ctr)
+                push_ready(ref.k, ref.u);
+        }
+        wheel_cnt[b] = 0;
+
         // mark ops to move to bus in order of tags
-        int min_tag;
-        exec_instr_t* oldest;
-        for (int r=0; r<bus_state.max; r++)
+        for (int r=0; (r<bus_state.max) && (ready_size>0); r++)
         {
-            min_tag = INT_MAX;
-            for (int k = 0; k < 3; k++)
-            {
-                for (int u = 0; u < exec_state[k].max; u++)
-                {
-                    if ((exec_state[k].unit[u].tag < min_tag) && exec_state[k].busy[u] && !exec_state[k].unit[u].to_bus)
-                    {
-                        min_tag = exec_state[k].unit[u].tag;
-                        oldest = &exec_state[k].unit[u];
-                    }
-                }
-            }
-            if (min_tag < INT_MAX)
-                oldest->to_bus = 1;   
+            ref = heap_pop(ready_heap, ready_size);
+            ready_cnt[ref.k]--;
+            fu_head(&exec_state[ref.k], ref.u)->to_bus = 1;
+            rs_latch++;
+            heap_push(bus_heap, bus_size, ref);
         }
     }
     
@@ -372,77 +636,112 @@ void procsim::bus(int clk)
     if (clk==0)
     {
         // cout << "bus start" << endl;
-        // Find oldest tag ready to be pushed to bus
-        int min_tag;
+        // Move oldest tags marked to bus
         int kk;
         int uu;
-        for (int r=0; r<bus_state.max; r++)
+        fu_ref_t ref;
+        int r;
+        for (r=0; (r<bus_state.max) && (bus_size>0); r++)
         {   
-            min_tag = -1;
-            for (int k = 0; k < 3; k++)
-            {
-                for (int u = 0; u<exec_state[k].max; u++)
-                {
-                    if (exec_state[k].unit[u].to_bus)
-                    {
-                        if (min_tag==-1)
-                        {
-                            min_tag = exec_state[k].unit[u].tag;
-                            kk = k;
-                            uu = u;
-                        }
-                        else if (min_tag > exec_state[k].unit[u].tag)
-                        {
-                            min_tag = exec_state[k].unit[u].tag;
-                            kk = k;
-                            uu = u;
-                        }
-                    }
-                }
-            }
-            // Check if any instrs marked to bus
-            int i;
-            if (min_tag!=-1)
-            {
-                bus_state.unit[r] = exec_state[kk].unit[uu];
-                bus_state.busy[r] = 1;
+            ref = heap_pop(bus_heap, bus_size);
+            kk = ref.k;
+            uu = ref.u;
+            exec_state_t* e = &exec_state[kk];
+            bus_state.unit[r] = *fu_head(e, uu);
+            bus_state.busy[r] = 1;
 
-                i = bus_state.unit[r].res_st;
-                res_st_state->buffer[i].update_cnt = clk_ctr;
-                // bus_state.unit[r].complete = 1;
-                exec_state[kk].unit[uu] = null_exec;
-                exec_state[kk].busy[uu] = 0;                
-                if (LOG)
-                {
-                    if (!logfile.is_open())
-                        logfile.open(logfp);
-                    logfile << clk_ctr << "\t" << "STATE UPDATE" << "\t" << bus_state.unit[r].tag << endl;
-                }
-            
+            int i = bus_state.unit[r].res_st;
+            res_st_state->buffer[i].update_cnt = clk_ctr;
+            // bus_state.unit[r].complete = 1;
+            // pop the head of the unit's in-flight ring
+            *fu_head(e, uu) = null_exec;
+            e->head[uu] = (e->head[uu] + 1) % e->depth;
+            e->count[uu]--;
+            e->busy[uu] = (e->count[uu] > 0);
+            rs_latch++;
+            // a new head that already finished joins the candidates now;
+            // one finishing this cycle is picked up from the wheel
+            if (e->busy[uu] && (fu_head(e, uu)->done < clk_ctr))
+                push_ready(kk, uu);
+            if (LOG)
+            {
+                if (!logfile.is_open())
+                    logfile.open(logfp);
+                logfile << clk_ctr << "\t" << "STATE UPDATE" << "\t" << bus_state.unit[r].tag << endl;
             }
         }
+        // a slot left empty this cycle drops its last result, unless the
+        // single-cycle model holds it there as it always has
+        if (!hold_bus)
+            for (; r < bus_state.max; r++)
+                bus_state.busy[r] = 0;
+        // finished results still held in a FU lost bus arbitration this cycle
+        for (int k = 0; k < 3; k++)
+            stall_ctrs.wait_bus[k] += ready_cnt[k];
     }
 }
 
 
+//
+// fill_instruction
+//
+//  Takes the next record of a preloaded trace for read_instruction;
+//  fields of a partially parsed line are filled in exactly as fscanf
+//  would have left them.
+//
+bool fill_instruction(trace_t* t, proc_inst_t* p_inst)
+{
+    trace_rec_t r;
+    next_trace_rec(t, &r);
+    if (r.ret > 0) p_inst->instruction_address = r.instruction_address;
+    if (r.ret > 1) p_inst->op_code    = r.op_code;
+    if (r.ret > 2) p_inst->dest_reg   = r.dest_reg;
+    if (r.ret > 3) p_inst->src_reg[0] = r.src_reg[0];
+    if (r.ret > 4) p_inst->src_reg[1] = r.src_reg[1];
+    return r.ret == 5;
+}
+
+//
+// retire_row
+//
+//  Prints one in-order row of the per-instruction table and checks it
+//  against the golden output; false once verification has failed.
+//
+bool procsim::retire_row(const proc_inst_t& instr)
+{
+    // print in order
+    if (DEBUG)
+    {
+        int tag        = instr.tag;
+        int fetch_cnt  = instr.fetch_cnt;
+        int disp_cnt   = instr.disp_cnt;
+        int sched_cnt  = instr.sched_cnt;
+        int exec_cnt   = instr.exec_cnt;
+        int update_cnt = instr.update_cnt;
+        cout << tag << "\t" << fetch_cnt << "\t" << disp_cnt << "\t" << sched_cnt << "\t" << exec_cnt << "\t" << update_cnt << endl;
+    }
+    // check against the golden table as rows retire
+    if (p_verifier)
+    {
+        int row[VERIFY_FIELDS] = {instr.tag, instr.fetch_cnt, instr.disp_cnt, instr.sched_cnt, instr.exec_cnt, instr.update_cnt};
+        if (!verify_row(p_verifier, row))
+            return false;
+    }
+    return true;
+}
+
 void procsim::update(int clk)
 {
     if (clk==1)
     {
         int i;
-        int tag;
-        int fetch_cnt;
-        int disp_cnt;
-        int sched_cnt;
-        int exec_cnt;
-        int update_cnt;
         // Write to reg file (printout)
         for (int r = 0; r < bus_state.max; r++)
         {
             if (bus_state.busy[r])
             {
                 i = bus_state.unit[r].res_st;
-                reorder_buffer.push_back(res_st_state->buffer[i]);
+                rob_push(res_st_state->buffer[i]);
             }
         }
         // sort_reorder_buffer();
@@ -451,19 +750,12 @@ void procsim::update(int clk)
 
         if (i!=-1)
         {
-            while (i!=-1)
+            // past-the-end fetches share tag_ctr and have no row of their
+            // own; default timing has always printed one if it got there
+            while ((i!=-1) && (hold_bus || (print_ctr < tag_ctr)))
             {
-                // print in order
-                if (DEBUG)
-                {
-                    tag        = reorder_buffer.at(i).tag;
-                    fetch_cnt  = reorder_buffer.at(i).fetch_cnt;
-                    disp_cnt   = reorder_buffer.at(i).disp_cnt;
-                    sched_cnt  = reorder_buffer.at(i).sched_cnt;
-                    exec_cnt   = reorder_buffer.at(i).exec_cnt;
-                    update_cnt = reorder_buffer.at(i).update_cnt;
-                    cout << tag << "\t" << fetch_cnt << "\t" << disp_cnt << "\t" << sched_cnt << "\t" << exec_cnt << "\t" << update_cnt << endl;
-                }
+                if (!retire_row(reorder_buffer.at(i)))
+                    break;
                 // increment print ctr and find next tag
                 print_ctr++;
                 i = find_tag_reorder(print_ctr);
@@ -474,11 +766,21 @@ void procsim::update(int clk)
     {
         // reg file read by dispatch - no real values
         // update schedule buffer
+        // Entries retired by a bus result that is still held are cleared
+        // and re-marked every cycle; only other updates change the RS
+        bool changed = false;
+        for (int r = 0; r < bus_state.max; r++)
+            if (bus_state.busy[r] && !res_st_state->buffer[bus_state.unit[r].res_st].retire)
+                changed = true;
+
         // 1. delete instr's marked to retire - Do this first to match output.
         for (int i = 0; i < res_st_state->max; i++)
         {
             if (res_st_state->buffer[i].retire)
             {
+                if (!changed && (res_st_state->busy[i] || !res_st_state->ready[i] ||
+                                 !is_retired_null(res_st_state->buffer[i]) || !on_bus(i)))
+                    changed = true;
                 // cout << "clk = " << clk_ctr << endl;
                 // print_instr(res_st_state->buffer[i]);
                 res_st_state->buffer[i] = null_inst;
@@ -503,6 +805,8 @@ void procsim::update(int clk)
                 retired_instructions++;
             }
         }
+        if (changed)
+            rs_latch++;
     }
 }
 
@@ -518,6 +822,214 @@ void procsim::pipeline(int clk)
     // print_instr(res_st_state->buffer[4]);
 }
 
+//
+// resume
+//
+//  Runs sub-phase clk of every stage that has work in it, in pipeline()
+//  order. A stage whose input latch has not moved since it last ran is
+//  left suspended; it only replays its per-cycle counters.
+//
+void procsim::resume(int clk)
+{
+    for (int n = phase_begin[clk]; n < phase_begin[clk + 1]; n++)
+    {
+        stage_t* st = &stages[n];
+        if (st->latch && (*st->latch == st->seen))
+        {
+            if (st->idle)
+                (this->*st->idle)();
+            continue;
+        }
+        if (st->latch)
+            st->seen = *st->latch;
+        (this->*st->step)(clk);
+    }
+}
+
+
+// Byte streams for the checkpoint snapshot; transfer() walks the state
+// once in the same order for saving and for loading
+typedef struct _state_out_t
+{
+    std::string* s;
+    bool         ok;
+    void io(void* p, size_t n)  { s->append((const char*)p, n); }
+    bool loading() const        { return false; }
+} state_out_t;
+
+typedef struct _state_in_t
+{
+    const char* p;
+    const char* end;
+    bool        ok;
+    void io(void* dst, size_t n)
+    {
+        if (!ok || ((size_t)(end - p) < n))
+        {
+            ok = false;
+            return;
+        }
+        memcpy(dst, p, n);
+        p += n;
+    }
+    bool loading() const        { return true; }
+} state_in_t;
+
+template <class A, class T>
+static void xfer(A& a, T& v, size_t n = 1)
+{
+    a.io(&v, n * sizeof(T));
+}
+
+template <class A>
+static void xfer_queue(A& a, std::queue<proc_inst_t>& q)
+{
+    uint64_t n = q.size();
+    xfer(a, n);
+    if (a.loading())
+    {
+        proc_inst_t e;
+        std::queue<proc_inst_t>().swap(q);
+        for (uint64_t i = 0; (i < n) && a.ok; i++)
+        {
+            xfer(a, e);
+            q.push(e);
+        }
+    }
+    else
+    {
+        for (std::queue<proc_inst_t> c = q; !c.empty(); c.pop())
+            xfer(a, c.front());
+    }
+}
+
+//
+// transfer
+//
+//  Saves or loads every piece of machine state except the reorder buffer
+//  and dispatch queue contents, which are checkpointed as streams; their
+//  sizes are included as a consistency check. Array sizes come from the
+//  configuration, which the checkpoint file header pins.
+//
+template <class A>
+void procsim::transfer(A& a)
+{
+    xfer(a, clk_ctr);
+    xfer(a, tag_ctr);
+    xfer(a, print_ctr);
+    xfer(a, fired_instructions);
+    xfer(a, retired_instructions);
+    xfer(a, stall_ctrs);
+
+    uint64_t rob_size  = reorder_buffer.size();
+    uint64_t disp_size = disp_state->Q.size();
+    xfer(a, rob_size);
+    xfer(a, disp_size);
+    a.ok = a.ok && (rob_size == reorder_buffer.size()) && (disp_size == disp_state->Q.size());
+    xfer(a, disp_pushed);
+    xfer(a, disp_size_sum);
+    xfer(a, max_disp_size);
+    xfer(a, fetch_state->ready);
+    xfer(a, disp_state->ready);
+    xfer_queue(a, fetch_state->Q);
+
+    xfer(a, res_st_state->buffer[0], res_st_state->max);
+    xfer(a, res_st_state->busy[0], res_st_state->max);
+    xfer(a, res_st_state->ready[0], res_st_state->max);
+    for (int k = 0; k < 3; k++)
+    {
+        xfer(a, exec_state[k].unit[0], exec_state[k].max * exec_state[k].depth);
+        xfer(a, exec_state[k].busy[0], exec_state[k].max);
+        xfer(a, exec_state[k].head[0], exec_state[k].max);
+        xfer(a, exec_state[k].count[0], exec_state[k].max);
+    }
+    xfer(a, bus_state.unit[0], bus_state.max);
+    xfer(a, bus_state.busy[0], bus_state.max);
+
+    xfer(a, bpred.ghr);
+    if (bpred.type != BP_NONE)
+        xfer(a, bpred.table[0], bp_words(&bpred));
+    xfer(a, fetch_stall);
+    xfer(a, have_pending);
+    xfer(a, pending_ok);
+    xfer(a, pending);
+
+    xfer(a, wheel[0], wheel_size * n_units);
+    xfer(a, wheel_cnt[0], wheel_size);
+    xfer(a, ready_size);
+    xfer(a, ready_heap[0], n_units);
+    xfer(a, ready_cnt);
+    xfer(a, bus_size);
+    xfer(a, bus_heap[0], n_units);
+    a.ok = a.ok && (ready_size <= n_units) && (bus_size <= n_units);
+
+    xfer(a, fetch_latch);
+    xfer(a, fire_latch);
+    xfer(a, rs_latch);
+    for (int n = 0; n < N_STAGES; n++)
+        xfer(a, stages[n].seen);
+    xfer(a, sched_idle);
+}
+
+//
+// save_checkpoint
+//
+//  Fills in the machine side of a checkpoint: reorder buffer entries from
+//  rob_from on, queued dispatch entries from stream index disp_from on,
+//  and the state snapshot.
+//
+void procsim::save_checkpoint(ckpt_rec_t* rec, uint64_t rob_from, uint64_t disp_from)
+{
+    rec->clk = clk_ctr;
+    rec->rob.assign((const char*)(reorder_buffer.data() + rob_from),
+                    (reorder_buffer.size() - rob_from) * sizeof(proc_inst_t));
+
+    rec->disp_first = disp_pushed - disp_state->Q.size();
+    rec->disp.clear();
+    uint64_t idx = rec->disp_first;
+    for (std::queue<proc_inst_t> q = disp_state->Q; !q.empty(); q.pop(), idx++)
+        if (idx >= disp_from)
+            rec->disp.append((const char*)&q.front(), sizeof(proc_inst_t));
+
+    rec->state.clear();
+    state_out_t out = {&rec->state, true};
+    transfer(out);
+}
+
+//
+// restore_checkpoint
+//
+//  Loads a snapshot taken by save_checkpoint into a machine reset to the
+//  same configuration, with the reorder buffer and dispatch queue rebuilt
+//  from their streams. False if the pieces do not fit together.
+//
+bool procsim::restore_checkpoint(const std::string& state, const std::string& rob,
+                                 const std::vector<proc_inst_t>& disp)
+{
+    proc_inst_t e;
+    reorder_buffer.clear();
+    rob_first.clear();
+    for (size_t i = 0; i + sizeof(e) <= rob.size(); i += sizeof(e))
+    {
+        memcpy(&e, rob.data() + i, sizeof(e));
+        rob_push(e);
+    }
+    std::queue<proc_inst_t>().swap(disp_state->Q);
+    for (size_t i = 0; i < disp.size(); i++)
+        disp_state->Q.push(disp[i]);
+
+    state_in_t in = {state.data(), state.data() + state.size(), true};
+    transfer(in);
+    return in.ok && (in.p == in.end);
+}
+
+// Re-emits the table rows retired before a restored checkpoint
+void procsim::replay_rows()
+{
+    for (int tag = 1; tag < print_ctr; tag++)
+        if (!retire_row(reorder_buffer.at(rob_first.at(tag))))
+            break;
+}
 
 /**
  * Subroutine for initializing the processor. You may add and initialize any global or heap
@@ -529,10 +1041,36 @@ void procsim::pipeline(int clk)
  * @k1 Number of k1 FUs
  * @k2 Number of k2 FUs
  * @f Number of instructions to fetch
+ * @latency Cycles per op for each FU type (NULL: DEFAULT_LATENCY)
+ * @pipelined Whether each FU type accepts a new op every cycle (NULL: none)
+ * @bp Branch predictor type, table size and mispredict penalty (NULL: off)
  */
-void setup_proc(uint64_t r, uint64_t k0, uint64_t k1, uint64_t k2, uint64_t f) 
+void setup_proc(uint64_t r, uint64_t k0, uint64_t k1, uint64_t k2, uint64_t f,
+                const int* latency, const bool* pipelined, const bpred_t* bp)
 {
-    p_proccessor = new procsim(r,k0,k1,k2,f);
+    if (p_proccessor)
+        p_proccessor->reset(r,k0,k1,k2,f,latency,pipelined,bp);
+    else
+        p_proccessor = new procsim(r,k0,k1,k2,f,latency,pipelined,bp);
+
+    // what a checkpoint must have been recorded with to be resumed
+    memset(&proc_config, 0, sizeof(proc_config));
+    proc_config.r  = r;
+    proc_config.k0 = k0;
+    proc_config.k1 = k1;
+    proc_config.k2 = k2;
+    proc_config.f  = f;
+    for (int i = 0; i < 3; i++)
+    {
+        proc_config.latency[i]   = latency ? latency[i] : DEFAULT_LATENCY;
+        proc_config.pipelined[i] = pipelined ? pipelined[i] : false;
+    }
+    if (bp && (bp->type != BP_NONE))
+    {
+        proc_config.bp_type    = bp->type;
+        proc_config.bp_bits    = bp->bits;
+        proc_config.bp_penalty = bp->penalty;
+    }
     if (LOG==1)
     {
         logfile.open(logfp);
@@ -545,6 +1083,140 @@ void setup_proc(uint64_t r, uint64_t k0, uint64_t k1, uint64_t k2, uint64_t f)
     
 }
 
+/**
+ * Compare every retired row against a golden output while running; the
+ * run stops at the first mismatch.
+ *
+ * @v Verifier opened on the golden output, or NULL to stop verifying
+ */
+void verify_proc(verifier_t* v)
+{
+    p_verifier = v;
+}
+
+/**
+ * Resume from the latest checkpoint in a checkpoint file that the loaded
+ * trace still agrees with, and record new checkpoints as the run goes.
+ * Table rows and log lines of the reused prefix are replayed from the
+ * checkpoints. Call after setup_proc and verify_proc.
+ *
+ * @c Checkpoint state for this run
+ * @path Checkpoint file, created if missing
+ * @interval Cycles between checkpoints
+ * @t The loaded trace; its fetch position moves to the checkpoint
+ */
+bool checkpoint_proc(checkpointer_t* c, const char* path, unsigned long interval, trace_t* t)
+{
+    ckpt_rec_t rec;
+    ckpt_rec_t last;
+    std::string rob;
+    std::string log;
+    std::vector<proc_inst_t> disp;  // dispatch stream from index disp_base
+    uint64_t disp_base = 0;
+    bool existed;
+
+    c->interval = interval;
+    existed = ckpt_open(c, path, &proc_config, t);
+    while (ckpt_next(c, &rec))
+    {
+        rob += rec.rob;
+        log += rec.log;
+        // keep only what is still queued, then add what is new
+        uint64_t drop = std::min<uint64_t>(rec.disp_first - disp_base, disp.size());
+        disp.erase(disp.begin(), disp.begin() + drop);
+        disp_base = rec.disp_first;
+        size_t n = disp.size();
+        disp.resize(n + rec.disp.size() / sizeof(proc_inst_t));
+        if (rec.disp.size())
+            memcpy(&disp[n], rec.disp.data(), rec.disp.size() - rec.disp.size() % sizeof(proc_inst_t));
+        last.clk      = rec.clk;
+        last.consumed = rec.consumed;
+        last.at_end   = rec.at_end;
+        last.state.swap(rec.state);
+    }
+
+    if (c->records > 0)
+    {
+        if (!p_proccessor->restore_checkpoint(last.state, rob, disp))
+        {
+            fprintf(stderr, "checkpoint: %s does not match this build, remove it to start over\n", path);
+            ckpt_close(c);
+            return false;
+        }
+        t->pos    = last.consumed;
+        t->at_end = last.at_end;
+        if (LOG)
+        {
+            logfile.close();
+            logfile.open(logfp);
+            logfile << log;
+            logfile.flush();
+        }
+        p_proccessor->replay_rows();
+        fprintf(stderr, "checkpoint: trace matches the recorded run for %lu+ instructions, resuming at cycle %d\n",
+                (unsigned long)c->matched, last.clk);
+    }
+    else if (existed)
+        fprintf(stderr, "checkpoint: no checkpoint in %s before the first changed instruction, starting at cycle 1\n", path);
+
+    if (!ckpt_start_writing(c))
+        return false;
+    c->rob_saved  = p_proccessor->get_rob_size();
+    c->disp_saved = p_proccessor->get_disp_pushed();
+    c->log_saved  = log.size();
+    p_ckpt = c;
+    return true;
+}
+
+// Appends a checkpoint of the machine at the current cycle boundary
+static void take_checkpoint(checkpointer_t* c)
+{
+    ckpt_rec_t rec;
+    uint64_t log_end = c->log_saved;
+    p_proccessor->save_checkpoint(&rec, c->rob_saved, c->disp_saved);
+    ckpt_fill_trace(c, &rec);
+    if (LOG && logfile.is_open())
+    {
+        // the log is written through an ofstream; read the new part back
+        logfile.flush();
+        log_end = logfile.tellp();
+        rec.log.resize(log_end - c->log_saved);
+        FILE* f = fopen(logfp.c_str(), "rb");
+        bool ok = f && (fseek(f, c->log_saved, SEEK_SET) == 0) &&
+                  (rec.log.empty() || (fread(&rec.log[0], 1, rec.log.size(), f) == rec.log.size()));
+        if (f)
+            fclose(f);
+        if (!ok)
+        {
+            fprintf(stderr, "checkpoint: failed to read back %s, checkpointing stopped\n", logfp.c_str());
+            ckpt_close(c);
+            p_ckpt = NULL;
+            return;
+        }
+    }
+    if (!ckpt_write(c, &rec))
+    {
+        ckpt_close(c);
+        p_ckpt = NULL;
+        return;
+    }
+    c->rob_saved  = p_proccessor->get_rob_size();
+    c->disp_saved = p_proccessor->get_disp_pushed();
+    c->log_saved  = log_end;
+}
+
+// Statistics after `cycles` complete cycles
+static void fill_stats(proc_stats_t* p_stats, unsigned long cycles)
+{
+    p_stats->cycle_count = cycles;
+    p_stats->avg_disp_size = p_proccessor->get_disp_size_sum() / p_stats->cycle_count;
+    p_stats->avg_inst_fired = p_proccessor->get_fired() / p_stats->cycle_count;
+    p_stats->retired_instruction = p_proccessor->get_retired();
+    p_stats->avg_inst_retired = p_proccessor->get_retired() / p_stats->cycle_count;
+    p_stats->max_disp_size = p_proccessor->get_max_disp_size();
+    p_stats->stalls = p_proccessor->get_stalls();
+}
+
 /**
  * Subroutine that simulates the processor.
  *   The processor should fetch instructions as appropriate, until all instructions have executed
@@ -554,26 +1226,32 @@ void setup_proc(uint64_t r, uint64_t k0, uint64_t k1, uint64_t k2, uint64_t f)
  */
 void run_proc(proc_stats_t* p_stats)
 {
-    bool incomplete = (p_proccessor->find_tag_reorder(p_proccessor->get_tag_ctr())==-1);
-    uint64_t disp_size_sum = 0;
-    p_stats->max_disp_size = 0;
+    bool incomplete = !p_proccessor->finished();
+    // resumed from a checkpoint
+    if (p_proccessor->get_clk_ctr() > 1)
+        fill_stats(p_stats, p_proccessor->get_clk_ctr() - 1);
+    if (p_verifier && p_verifier->failed)
+        incomplete = false;
     while (incomplete)
     {
         for (int c=0; c < 3; c++)
         {
+#ifdef LEGACY_STAGES
             p_proccessor->pipeline(c);
+#else
+            p_proccessor->resume(c);
+#endif
             // cout << "clk " << p_proccessor->get_clk_ctr() << " " << c << endl;
         }
-        p_stats->cycle_count = p_proccessor->get_clk_ctr();
-        disp_size_sum += p_proccessor->get_disp_state()->Q.size();
-        p_stats->avg_disp_size = disp_size_sum / p_stats->cycle_count;
-        p_stats->avg_inst_fired = fired_instructions / p_stats->cycle_count;
-        p_stats->retired_instruction = retired_instructions;
-        p_stats->avg_inst_retired = retired_instructions / p_stats->cycle_count;
-        if (p_proccessor->get_disp_state()->Q.size() > p_stats->max_disp_size)
-            p_stats->max_disp_size = p_proccessor->get_disp_state()->Q.size();
+        p_proccessor->sample_disp();
+        fill_stats(p_stats, p_proccessor->get_clk_ctr());
         p_proccessor->inc_clk_ctr();
-        incomplete = (p_proccessor->find_tag_reorder(p_proccessor->get_tag_ctr())==-1);
+        if (p_ckpt && !(p_verifier && p_verifier->failed) &&
+            ((p_proccessor->get_clk_ctr() - 1) % p_ckpt->interval == 0))
+            take_checkpoint(p_ckpt);
+        incomplete = !p_proccessor->finished();
+        if (p_verifier && p_verifier->failed)
+            break;
     }
 }
 
@@ -587,5 +1265,9 @@ void run_proc(proc_stats_t* p_stats)
 void complete_proc(proc_stats_t *p_stats) 
 {
     delete p_proccessor;
+    p_proccessor = NULL;
+    if (p_ckpt)
+        ckpt_close(p_ckpt);
+    p_ckpt = NULL;
     logfile.close();
 }
@@ -3,21 +3,35 @@
 
 #include <cstdint>
 #include <cstdio>
+#include <cstring>
 #include <iostream>
 #include <queue>
+#include <stdexcept>
 #include <string>
+#include <tuple>
 #include <vector>
 #include <algorithm>
+#include <functional>
+#include "arena.hpp"
+#include "bpred.hpp"
+#include "checkpoint.hpp"
+#include "verify.hpp"
 
 #define DEFAULT_K0 3
 #define DEFAULT_K1 2
 #define DEFAULT_K2 1
 #define DEFAULT_R 2
 #define DEFAULT_F 4
+#define DEFAULT_LATENCY 1
+#define MAX_LATENCY 4096    // FU latency cap; the completion wheel is sized by it
 
 #define VERBOSE 0
-#define DEBUG 1
-#define LOG 1
+#ifndef DEBUG
+#define DEBUG 1     // print the per-instruction table
+#endif
+#ifndef LOG
+#define LOG 1       // write procsim.log
+#endif
 
 typedef struct _proc_inst_t
 {
@@ -40,6 +54,33 @@ typedef struct _proc_inst_t
 
 const proc_inst_t null_inst;
 
+// Field-by-field equality; a field added to proc_inst_t must be added here
+inline bool same_inst(const proc_inst_t& a, const proc_inst_t& b)
+{
+    static_assert(sizeof(proc_inst_t) == 15 * sizeof(int), "proc_inst_t changed: update same_inst");
+    return std::tie(a.tag, a.instruction_address, a.op_code, a.src_reg[0], a.src_reg[1], a.dest_reg,
+                    a.fire, a.retire, a.dep_rs[0], a.dep_rs[1], a.fu_unit, a.fetch_cnt,
+                    a.disp_cnt, a.sched_cnt, a.exec_cnt, a.update_cnt) ==
+           std::tie(b.tag, b.instruction_address, b.op_code, b.src_reg[0], b.src_reg[1], b.dest_reg,
+                    b.fire, b.retire, b.dep_rs[0], b.dep_rs[1], b.fu_unit, b.fetch_cnt,
+                    b.disp_cnt, b.sched_cnt, b.exec_cnt, b.update_cnt);
+}
+
+// Stall attribution counters, accumulated every cycle
+typedef struct _stall_stats_t
+{
+    unsigned long sched_slots;   // dispatch queue -> RS slots offered (up to F per cycle)
+    unsigned long sched_rs_full; // slots lost because no RS entry was ready
+    unsigned long fu_slots[3];   // FU-cycles available per FU type
+    unsigned long issued[3];     // instructions fired per FU type
+    unsigned long wait_dep[3];   // RS entry-cycles waiting on dep_rs producers
+    unsigned long wait_fu[3];    // RS entry-cycles ready but no free FU of its op_code
+    unsigned long wait_bus[3];   // FU-cycles holding a result that lost bus arbitration
+    unsigned long branches_taken;    // address discontinuities seen by fetch
+    unsigned long mispredicts;
+    unsigned long fetch_slots_lost;  // fetch slots idle while redirecting
+} stall_stats_t;
+
 typedef struct _proc_stats_t
 {
     float avg_inst_retired;
@@ -48,6 +89,7 @@ typedef struct _proc_stats_t
     unsigned long max_disp_size;
     unsigned long retired_instruction;
     unsigned long cycle_count;
+    stall_stats_t stalls;
 } proc_stats_t;
 
 typedef struct _queue_state_t
@@ -70,6 +112,7 @@ typedef struct _exec_instr_t
     int  tag = -1;
     int  res_st = -1;
     int  dest_reg = -1;
+    int  done = -1;     // cycle the result is ready for the bus
     bool to_bus = 0;
 } exec_instr_t;
 
@@ -77,12 +120,76 @@ const exec_instr_t null_exec;
 
 typedef struct _exec_state_t
 {
-    exec_instr_t* unit;
+    exec_instr_t* unit;     // per unit, a ring of `depth` in-flight ops
     int           max;
-    bool*         busy;
+    bool*         busy;     // unit holds at least one op
     // bool          ready = 0;
+    int           latency = 1;
+    int           depth   = 1;      // latency if pipelined, else 1
+    int*          head    = NULL;   // ring index of the oldest op per unit
+    int*          count   = NULL;   // ops in flight per unit
 } exec_state_t;
 
+// Oldest in-flight op of unit u - the only one that can leave for the bus
+inline exec_instr_t* fu_head(exec_state_t* e, int u)
+{
+    return &e->unit[u*e->depth + e->head[u]];
+}
+
+// Bit sets over RS entries, one bit per entry in 64-bit words
+inline void bits_set(uint64_t* b, int i)
+{
+    b[i >> 6] |= 1ull << (i & 63);
+}
+
+inline void bits_clear(uint64_t* b, int i)
+{
+    b[i >> 6] &= ~(1ull << (i & 63));
+}
+
+inline bool bits_test(const uint64_t* b, int i)
+{
+    return (b[i >> 6] >> (i & 63)) & 1;
+}
+
+// Reference to a FU, keyed for bus arbitration by the tag it holds.
+// Ties go to the lower (type, unit), the order the old scans used.
+typedef struct _fu_ref_t
+{
+    int tag;
+    int k;
+    int u;
+} fu_ref_t;
+
+inline bool operator>(const fu_ref_t& a, const fu_ref_t& b)
+{
+    if (a.tag != b.tag) return a.tag > b.tag;
+    if (a.k != b.k)     return a.k > b.k;
+    return a.u > b.u;
+}
+
+class procsim;
+
+// A stage sub-phase as a resumable object. It stays suspended while the
+// input latch it watches is unchanged since it last ran; a run that
+// changes the stage's own inputs bumps the latch and so resumes it.
+typedef struct _stage_t
+{
+    void (procsim::*step)(int);
+    int             clk;        // sub-phase it has work in
+    unsigned long*  latch;      // input version, NULL: runs every cycle
+    unsigned long   seen;       // latch value when it last ran
+    void (procsim::*idle)();    // bookkeeping for a suspended cycle, or NULL
+} stage_t;
+
+#define N_STAGES 10
+
+// Registers with their own scoreboard row; producers of any other
+// register share one row and are told apart by comparing dest_reg
+#ifndef SB_REGS
+#define SB_REGS 64
+#endif
+
 // typedef struct _bus_state_t
 // {
 //     std::vector<proc_inst_t> bus;
@@ -103,6 +210,9 @@ private:
     int tag_ctr   = 1;
     int print_ctr = 1;
     int  fetch_rate;
+    unsigned long fired_instructions   = 0;
+    unsigned long retired_instructions = 0;
+    stall_stats_t stall_ctrs;
     // uint8_t  num_buses;
     // uint8_t  num_k0;
     // uint8_t  num_k1;
@@ -114,69 +224,325 @@ private:
     exec_state_t*   exec_state;
     exec_state_t    bus_state;
     std::vector<proc_inst_t> reorder_buffer;
+    std::vector<int> rob_first;     // tag -> first reorder_buffer index, -1 if none
+    uint64_t        disp_pushed   = 0;  // entries ever appended to the dispatch queue
+    uint64_t        disp_size_sum = 0;  // dispatch queue size summed over cycles
+    unsigned long   max_disp_size = 0;
+
+    // Front end: one instruction of lookahead resolves whether the last
+    // fetched one was a taken branch
+    bpred_t         bpred;
+    int             fetch_stall  = 0;   // cycles left before fetch resumes
+    bool            have_pending = false;
+    bool            pending_ok   = false;
+    proc_inst_t     pending;
+
+    // Every array below and in the state structs is carved from one arena
+    arena_t         arena;
+    queue_state_t   fetch_q;
+    queue_state_t   disp_q;
+    res_st_state_t  res_st;
+    exec_state_t    exec[3];
+
+    // Completion scheduling: fired ops are posted to the wheel bucket of
+    // their done cycle; unit heads that are done wait in ready_heap and
+    // those granted a bus in bus_heap, both ordered by tag.
+    int       n_units;
+    int       wheel_size;   // power of two >= max FU latency
+    fu_ref_t* wheel;        // wheel_size buckets of n_units refs
+    int*      wheel_cnt;
+    fu_ref_t* ready_heap;
+    int       ready_size = 0;
+    int       ready_cnt[3] = {0,0,0};
+    fu_ref_t* bus_heap;
+    int       bus_size = 0;
+    bool      hold_bus = true;  // default timing: results stay on the bus until replaced
+
+    // Stage scheduling: only the sub-phases a stage has work in are in the
+    // table, ordered by phase and then update..fetch as in pipeline()
+    stage_t         stages[N_STAGES];
+    int             phase_begin[4];
+    unsigned long   fetch_latch = 0;    // fetch queue filled
+    unsigned long   fire_latch  = 0;    // RS entries marked to fire
+    unsigned long   rs_latch    = 0;    // RS entries or FU occupancy changed
+    stall_stats_t   sched_idle;         // schedule(1) counters for an unchanged cycle
+
+    // Register scoreboard, rebuilt by each dependency pass of schedule(1):
+    // rows of sb_words words with one bit per RS entry
+    int             sb_words;
+    uint64_t*       sb_prod;        // per register, live entries writing it
+    uint64_t*       sb_other;       // live entries writing a register >= SB_REGS or < -1
+    uint64_t*       sb_free[2];     // entries whose dep_rs[n] is unset
+    uint64_t*       sb_waiters;     // per RS entry, entries whose dep_rs[0] is it
+    uint64_t*       sb_retired;     // entries marked to retire
+    uint64_t*       sb_woken;
+    bool link_producers();
+    bool wake_consumers();
+
+    void add_stage(int& n, void (procsim::*step)(int), int clk,
+                   unsigned long* latch = NULL, void (procsim::*idle)() = NULL)
+    {
+        stage_t st = {step, clk, latch, ~0ul, idle};
+        stages[n++] = st;
+    }
+    void schedule_idle()
+    {
+        for (int k = 0; k < 3; k++)
+        {
+            stall_ctrs.fu_slots[k] += sched_idle.fu_slots[k];
+            stall_ctrs.wait_dep[k] += sched_idle.wait_dep[k];
+            stall_ctrs.wait_fu[k]  += sched_idle.wait_fu[k];
+        }
+    }
+    // Cleared RS entry that a held bus result marked to retire again
+    static bool is_retired_null(const proc_inst_t& i)
+    {
+        static const proc_inst_t retired_null = []() { proc_inst_t r; r.retire = 1; return r; }();
+        return same_inst(i, retired_null);
+    }
+    bool on_bus(int entry)
+    {
+        for (int r = 0; r < bus_state.max; r++)
+            if (bus_state.busy[r] && (bus_state.unit[r].res_st == entry))
+                return true;
+        return false;
+    }
+    void rob_push(const proc_inst_t& instr)
+    {
+        if ((instr.tag >= 0) && ((size_t)instr.tag >= rob_first.size()))
+            rob_first.resize(instr.tag + 1, -1);
+        if ((instr.tag >= 0) && (rob_first[instr.tag] == -1))
+            rob_first[instr.tag] = reorder_buffer.size();
+        reorder_buffer.push_back(instr);
+    }
+
+    // Walks all checkpointed state, for saving or loading
+    template <class A> void transfer(A& a);
+
+    void heap_push(fu_ref_t* h, int& n, fu_ref_t ref)
+    {
+        h[n++] = ref;
+        std::push_heap(h, h + n, std::greater<fu_ref_t>());
+    }
+    fu_ref_t heap_pop(fu_ref_t* h, int& n)
+    {
+        std::pop_heap(h, h + n, std::greater<fu_ref_t>());
+        return h[--n];
+    }
+    void push_ready(int k, int u)
+    {
+        fu_ref_t ref = {fu_head(&exec_state[k], u)->tag, k, u};
+        heap_push(ready_heap, ready_size, ref);
+        ready_cnt[k]++;
+    }
+    // Lay out all arrays in the arena; sizes only when arena.base is NULL
+    void carve(int r, int k0, int k1, int k2)
+    {
+        res_st_state->max    = 2*(k0 + k1 + k2);
+        res_st_state->buffer = (proc_inst_t*)arena_alloc(&arena, res_st_state->max * sizeof(proc_inst_t));
+        res_st_state->busy   = (bool*)arena_alloc(&arena, res_st_state->max * sizeof(bool));
+        res_st_state->ready  = (bool*)arena_alloc(&arena, res_st_state->max * sizeof(bool));
+
+        exec_state[0].max = k0;
+        exec_state[1].max = k1;
+        exec_state[2].max = k2;
+        for (int i=0;i<3;i++)
+        {
+            exec_state[i].unit  = (exec_instr_t*)arena_alloc(&arena, exec_state[i].max * exec_state[i].depth * sizeof(exec_instr_t));
+            exec_state[i].busy  = (bool*)arena_alloc(&arena, exec_state[i].max * sizeof(bool));
+            exec_state[i].head  = (int*)arena_alloc(&arena, exec_state[i].max * sizeof(int));
+            exec_state[i].count = (int*)arena_alloc(&arena, exec_state[i].max * sizeof(int));
+        }
+
+        bus_state.max  = r;
+        bus_state.unit = (exec_instr_t*)arena_alloc(&arena, r * sizeof(exec_instr_t));
+        bus_state.busy = (bool*)arena_alloc(&arena, r * sizeof(bool));
+
+        n_units    = k0 + k1 + k2;
+        wheel      = (fu_ref_t*)arena_alloc(&arena, wheel_size * n_units * sizeof(fu_ref_t));
+        wheel_cnt  = (int*)arena_alloc(&arena, wheel_size * sizeof(int));
+        ready_heap = (fu_ref_t*)arena_alloc(&arena, n_units * sizeof(fu_ref_t));
+        bus_heap   = (fu_ref_t*)arena_alloc(&arena, n_units * sizeof(fu_ref_t));
+
+        sb_words   = (res_st_state->max + 63) / 64;
+        sb_prod    = (uint64_t*)arena_alloc(&arena, SB_REGS * sb_words * sizeof(uint64_t));
+        sb_other   = (uint64_t*)arena_alloc(&arena, sb_words * sizeof(uint64_t));
+        sb_free[0] = (uint64_t*)arena_alloc(&arena, sb_words * sizeof(uint64_t));
+        sb_free[1] = (uint64_t*)arena_alloc(&arena, sb_words * sizeof(uint64_t));
+        sb_waiters = (uint64_t*)arena_alloc(&arena, res_st_state->max * sb_words * sizeof(uint64_t));
+        sb_retired = (uint64_t*)arena_alloc(&arena, sb_words * sizeof(uint64_t));
+        sb_woken   = (uint64_t*)arena_alloc(&arena, sb_words * sizeof(uint64_t));
+
+        if (bpred.type != BP_NONE)
+            bpred.table = (uint64_t*)arena_alloc(&arena, bp_words(&bpred) * sizeof(uint64_t));
+    }
 public:
-    procsim(uint64_t r, uint64_t k0, uint64_t k1, uint64_t k2, uint64_t f) :
-        fetch_rate(f)
-        {   
-            fetch_state = new queue_state_t;
-            // fetch_state->size  = 0;
-            fetch_state->ready = 1; // always fetch
-
-            disp_state = new queue_state_t;
-            // disp_state->size   = 0;
-            disp_state->ready  = 0; // initially no data in fetch, can't dispatch
-
-            res_st_state = new res_st_state_t;
-            res_st_state->max   = 2*(k0 + k1 + k2);
-            res_st_state->buffer = new proc_inst_t[res_st_state->max];
-            res_st_state->busy   = new bool[res_st_state->max];
-            res_st_state->ready  = new bool[res_st_state->max];
-            for (int i = 0; i < res_st_state->max; i++)
+    procsim(uint64_t r, uint64_t k0, uint64_t k1, uint64_t k2, uint64_t f,
+            const int* latency = NULL, const bool* pipelined = NULL,
+            const bpred_t* bp = NULL)
+        {
+            reset(r, k0, k1, k2, f, latency, pipelined, bp);
+        }
+    ~procsim()
+    {
+        arena_release(&arena);
+    }
+
+    //
+    // reset
+    //
+    //  Returns the instance to its power-on state for a new configuration.
+    //  The arena is reused whenever it is large enough, so a sweep can run
+    //  many configurations through one instance without reallocating.
+    //
+    void reset(uint64_t r, uint64_t k0, uint64_t k1, uint64_t k2, uint64_t f,
+               const int* latency = NULL, const bool* pipelined = NULL,
+               const bpred_t* bp = NULL)
+    {
+        clk_ctr    = 1;
+        tag_ctr    = 1;
+        print_ctr  = 1;
+        fetch_rate = f;
+        fired_instructions   = 0;
+        retired_instructions = 0;
+        stall_ctrs = stall_stats_t();
+        reorder_buffer.clear();
+        rob_first.clear();
+        disp_pushed   = 0;
+        disp_size_sum = 0;
+        max_disp_size = 0;
+
+        fetch_state = &fetch_q;
+        std::queue<proc_inst_t>().swap(fetch_state->Q);
+        // fetch_state->size  = 0;
+        fetch_state->ready = 1; // always fetch
+
+        disp_state = &disp_q;
+        std::queue<proc_inst_t>().swap(disp_state->Q);
+        // disp_state->size   = 0;
+        disp_state->ready  = 0; // initially no data in fetch, can't dispatch
+
+        bpred = bp ? *bp : bpred_t();
+        bpred.table  = NULL;
+        fetch_stall  = 0;
+        have_pending = false;
+
+        res_st_state = &res_st;
+        exec_state   = exec;
+        wheel_size   = 1;
+        hold_bus     = true;
+        for (int i=0;i<3;i++)
+        {
+            exec_state[i].latency = latency ? latency[i] : DEFAULT_LATENCY;
+            if ((exec_state[i].latency < 1) || (exec_state[i].latency > MAX_LATENCY))
+                throw std::invalid_argument("FU latency must be 1-" + std::to_string(MAX_LATENCY));
+            exec_state[i].depth   = (pipelined && pipelined[i]) ? exec_state[i].latency : 1;
+            if ((exec_state[i].latency != DEFAULT_LATENCY) || (exec_state[i].depth != 1))
+                hold_bus = false;
+            while (wheel_size < exec_state[i].latency)
+                wheel_size <<= 1;
+        }
+        ready_size = 0;
+        bus_size   = 0;
+        for (int i=0;i<3;i++)
+            ready_cnt[i] = 0;
+
+        // size, then carve the arena
+        char* base = arena.base;
+        arena.base = NULL;
+        arena.used = 0;
+        carve(r, k0, k1, k2);
+        arena.base = base;
+        arena_reserve(&arena, arena.used);
+        carve(r, k0, k1, k2);
+        // the scoreboard layout depends on the RS size; drop the last run's rows
+        memset(sb_prod, 0, SB_REGS * sb_words * sizeof(uint64_t));
+        memset(sb_waiters, 0, res_st_state->max * sb_words * sizeof(uint64_t));
+        memset(sb_other, 0, sb_words * sizeof(uint64_t));
+        memset(sb_free[0], 0, sb_words * sizeof(uint64_t));
+        memset(sb_free[1], 0, sb_words * sizeof(uint64_t));
+        memset(sb_retired, 0, sb_words * sizeof(uint64_t));
+        memset(sb_woken, 0, sb_words * sizeof(uint64_t));
+
+        for (int i = 0; i < res_st_state->max; i++)
+        {
+            res_st_state->buffer[i] = null_inst;
+            res_st_state->busy[i]   = 0;
+            res_st_state->ready[i]  = 0;
+        }
+        for (int i=0;i<3;i++)
+        {
+            for (int j=0;j<exec_state[i].max*exec_state[i].depth;j++)
+                exec_state[i].unit[j] = null_exec;
+            for (int j=0;j<exec_state[i].max;j++)
             {
-                res_st_state->buffer[i] = null_inst;
-                res_st_state->busy[i]   = 0;
-                res_st_state->ready[i]  = 0;
+                exec_state[i].busy[j]  = 0;
+                exec_state[i].head[j]  = 0;
+                exec_state[i].count[j] = 0;
             }
-
-            exec_state = new exec_state_t[3];
-            exec_state[0].max   = k0;
-            exec_state[0].unit  = new exec_instr_t[k0];
-            exec_state[0].busy  = new bool[k0];
-            exec_state[1].max   = k1;
-            exec_state[1].unit  = new exec_instr_t[k1];
-            exec_state[1].busy  = new bool[k1];
-            exec_state[2].max   = k2;
-            exec_state[2].unit  = new exec_instr_t[k2];
-            exec_state[2].busy  = new bool[k2];
-            for (int i=0;i<3;i++)
-                for (int j=0;j<exec_state[i].max;j++)
-                    exec_state[i].busy[j] = 0;
-
-            bus_state.max   = r;
-            bus_state.unit  = new exec_instr_t[r];
-            bus_state.busy  = new bool[r];
-            for (int i=0;i<bus_state.max;i++)
-                    bus_state.busy[i] = 0;
-            // bus_state.ready = 0;
         }
-    ~procsim()
+        for (int i=0;i<bus_state.max;i++)
+        {
+            bus_state.unit[i] = null_exec;
+            bus_state.busy[i] = 0;
+        }
+        // bus_state.ready = 0;
+        for (int i=0;i<wheel_size;i++)
+            wheel_cnt[i] = 0;
+        if (bpred.type != BP_NONE)
+            bp_clear(&bpred);
+
+        fetch_latch = 0;
+        fire_latch  = 0;
+        rs_latch    = 0;
+        sched_idle  = stall_stats_t();
+        int n = 0;
+        phase_begin[0] = n;
+        add_stage(n, &procsim::bus, 0);
+        add_stage(n, &procsim::execute, 0, &fire_latch);
+        add_stage(n, &procsim::schedule, 0);
+        add_stage(n, &procsim::dispatch, 0, &fetch_latch);
+        add_stage(n, &procsim::fetch, 0);
+        phase_begin[1] = n;
+        add_stage(n, &procsim::update, 1);
+        add_stage(n, &procsim::execute, 1);
+        add_stage(n, &procsim::schedule, 1, &rs_latch, &procsim::schedule_idle);
+        add_stage(n, &procsim::dispatch, 1, &rs_latch);
+        phase_begin[2] = n;
+        add_stage(n, &procsim::update, 2);
+        phase_begin[3] = n;
+    }
+
+    bool retire_row(const proc_inst_t& instr);
+    void sample_disp()
     {
-        delete fetch_state;
-        delete disp_state;
-        delete res_st_state->buffer;
-        delete res_st_state->busy;
-        delete res_st_state->ready;
-        delete res_st_state;
-        delete exec_state->unit;
-        delete exec_state->busy;
-        delete exec_state;
-        delete bus_state.unit;
-        delete bus_state.busy;
+        disp_size_sum += disp_state->Q.size();
+        if (disp_state->Q.size() > max_disp_size)
+            max_disp_size = disp_state->Q.size();
     }
+    void save_checkpoint(ckpt_rec_t* rec, uint64_t rob_from, uint64_t disp_from);
+    bool restore_checkpoint(const std::string& state, const std::string& rob,
+                            const std::vector<proc_inst_t>& disp);
+    void replay_rows();
 
+    // A run ends when an instruction fetched past the end of the trace
+    // (tagged tag_ctr) reaches the ROB. With default timing that is where
+    // the table has always stopped; otherwise every trace instruction
+    // must have printed its row too.
+    bool finished()
+    {
+        return (find_tag_reorder(tag_ctr) != -1) && (hold_bus || (print_ctr >= tag_ctr));
+    }
     int get_clk_ctr()    const  {return clk_ctr;}
     void inc_clk_ctr()          {clk_ctr++;}
     int get_tag_ctr()    const  {return tag_ctr;}
+    unsigned long get_fired()   const {return fired_instructions;}
+    unsigned long get_retired() const {return retired_instructions;}
+    uint64_t get_disp_size_sum()    const {return disp_size_sum;}
+    unsigned long get_max_disp_size() const {return max_disp_size;}
+    size_t get_rob_size()           const {return reorder_buffer.size();}
+    uint64_t get_disp_pushed()      const {return disp_pushed;}
+    const stall_stats_t& get_stalls() const {return stall_ctrs;}
     int get_fetch_rate() const  {return fetch_rate;}
     // int get_num_buses() {return num_buses;}
     // int get_num_k0()    {return num_k0;}
@@ -196,6 +562,7 @@ public:
     void bus(int clk);
     void update(int clk);
     void pipeline(int clk);
+    void resume(int clk);
 
     
 
@@ -225,6 +592,8 @@ public:
 
     int find_tag_reorder(int tag)
     {
+        if (tag >= 0)
+            return ((size_t)tag < rob_first.size()) ? rob_first[tag] : -1;
         int i = 0;
         for (auto instr : reorder_buffer)
         {
@@ -238,8 +607,13 @@ public:
 };
 
 bool read_instruction(proc_inst_t* p_inst);
+bool fill_instruction(trace_t* t, proc_inst_t* p_inst);
 
-void setup_proc(uint64_t r, uint64_t k0, uint64_t k1, uint64_t k2, uint64_t f);
+void setup_proc(uint64_t r, uint64_t k0, uint64_t k1, uint64_t k2, uint64_t f,
+                const int* latency = NULL, const bool* pipelined = NULL,
+                const bpred_t* bp = NULL);
+void verify_proc(verifier_t* v);
+bool checkpoint_proc(checkpointer_t* c, const char* path, unsigned long interval, trace_t* t);
 void run_proc(proc_stats_t* p_stats);
 void complete_proc(proc_stats_t* p_stats);
 
@@ -1,20 +1,41 @@
 #include <cstdio>
 #include <cinttypes>
+#include <chrono>
+#include <thread>
 #include <cstdlib>
 #include <cstring>
+#include <cerrno>
 #include <unistd.h>
+#include <getopt.h>
 #include "procsim.hpp"
+#include "trace.hpp"
 
 FILE* inFile = stdin;
+trace_t trace;
+bool stall_report = false;
 
 void print_help_and_exit(void) {
     printf("procsim [OPTIONS]\n");
     printf("  -j k0\t\tNumber of k0 FUs\n");
     printf("  -k k1\t\tNumber of k1 FUs\n");
     printf("  -l k2\t\tNumber of k2 FUs\n");   
+    printf("  -J n\t\tLatency of k0 FUs in cycles (1-%d)\n", MAX_LATENCY);
+    printf("  -K n\t\tLatency of k1 FUs in cycles (1-%d)\n", MAX_LATENCY);
+    printf("  -L n\t\tLatency of k2 FUs in cycles (1-%d)\n", MAX_LATENCY);
+    printf("  -p t\t\tPipeline FU type t (0-2), may be repeated\n");
+    printf("  -b type\tBranch predictor: bimodal or gshare (default off)\n");
+    printf("  -t bits\tlog2 of predictor counters (default %d)\n", DEFAULT_BP_BITS);
+    printf("  -m n\t\tMispredict fetch stall in cycles (default %d)\n", DEFAULT_BP_PENALTY);
     printf("  -f N\t\tNumber of instructions to fetch\n");
     printf("  -r R\t\tNumber of result buses\n");
     printf("  -i traces/file.trace\n");
+    printf("  -T n\t\tTrace loader threads (default: all cores, 1 = serial)\n");
+    printf("  -s\t\tPrint stall breakdown report\n");
+    printf("  -C, --checkpoint file\n");
+    printf("\t\tResume from the latest checkpoint still valid for this trace, record new ones\n");
+    printf("  -I n\t\tCycles between checkpoints (default %d)\n", DEFAULT_CKPT_INTERVAL);
+    printf("  -V, --verify golden.output\n");
+    printf("\t\tCheck each retired row against a golden output, stop at the first mismatch\n");
     printf("  -h\t\tThis helpful output\n");
     exit(0);
 }
@@ -22,26 +43,40 @@ void print_help_and_exit(void) {
 //
 // read_instruction
 //
-//  returns true if an instruction was read successfully
+//  returns true if an instruction was read successfully. Records come
+//  from the trace preloaded by load_trace.
 //
 bool read_instruction(proc_inst_t* p_inst)
 {
-    int ret;
     if (p_inst == NULL)
     {
         fprintf(stderr, "Fetch requires a valid pointer to populate\n");
         return false;
     }
     
-    ret = fscanf(inFile, "%x %d %d %d %d\n", &p_inst->instruction_address,
-                 &p_inst->op_code, &p_inst->dest_reg, &p_inst->src_reg[0], &p_inst->src_reg[1]); 
-    if (ret != 5) {
+    return fill_instruction(&trace, p_inst);
+}
+
+//
+// parse_int
+//
+//  True if s is a whole decimal integer in [lo, hi]; atoi would take
+//  "12abc" as 12 and "abc" as 0.
+//
+static bool parse_int(const char* s, long lo, long hi, int* out)
+{
+    char* end;
+    errno = 0;
+    long v = strtol(s, &end, 10);
+    if ((end == s) || *end || errno || (v < lo) || (v > hi))
         return false;
-    }
+    *out = (int)v;
     return true;
 }
 
 void print_statistics(proc_stats_t* p_stats);
+void print_stall_report(proc_stats_t* p_stats);
+void print_frontend_statistics(proc_stats_t* p_stats);
 
 int main(int argc, char* argv[]) {
     int opt;
@@ -50,9 +85,23 @@ int main(int argc, char* argv[]) {
     uint64_t k1 = DEFAULT_K1;
     uint64_t k2 = DEFAULT_K2;
     uint64_t r = DEFAULT_R;
+    int  latency[3]   = {DEFAULT_LATENCY, DEFAULT_LATENCY, DEFAULT_LATENCY};
+    bool pipelined[3] = {false, false, false};
+    int  fu_type;
+    bpred_t bp;
+    const char* golden = NULL;
+    const char* ckpt_path = NULL;
+    unsigned long ckpt_interval = DEFAULT_CKPT_INTERVAL;
+    int load_threads = std::max(1u, std::thread::hardware_concurrency());
+    static struct option long_opts[] = {
+        {"verify", required_argument, NULL, 'V'},
+        {"checkpoint", required_argument, NULL, 'C'},
+        {"help",   no_argument,       NULL, 'h'},
+        {NULL, 0, NULL, 0}
+    };
 
     /* Read arguments */ 
-    while(-1 != (opt = getopt(argc, argv, "r:i:j:k:l:f:h"))) {
+    while(-1 != (opt = getopt_long(argc, argv, "r:i:j:k:l:f:J:K:L:p:b:t:m:sT:V:C:I:h", long_opts, NULL))) {
         switch(opt) {
         case 'r':
             r = atoi(optarg);
@@ -69,6 +118,49 @@ int main(int argc, char* argv[]) {
         case 'f':
             f = atoi(optarg);
             break;
+        case 'J':
+        case 'K':
+        case 'L':
+            // -J/-K/-L set k0/k1/k2 latency
+            if (!parse_int(optarg, 1, MAX_LATENCY, &latency[opt - 'J']))
+            {
+                fprintf(stderr, "FU latency must be 1-%d\n", MAX_LATENCY);
+                print_help_and_exit();
+            }
+            break;
+        case 'p':
+            if (!parse_int(optarg, 0, 2, &fu_type))
+            {
+                fprintf(stderr, "Unknown FU type %s\n", optarg);
+                print_help_and_exit();
+            }
+            pipelined[fu_type] = true;
+            break;
+        case 'b':
+            if (!strcmp(optarg, "bimodal"))
+                bp.type = BP_BIMODAL;
+            else if (!strcmp(optarg, "gshare"))
+                bp.type = BP_GSHARE;
+            else
+            {
+                fprintf(stderr, "Unknown branch predictor %s\n", optarg);
+                print_help_and_exit();
+            }
+            break;
+        case 't':
+            if (!parse_int(optarg, 1, MAX_BP_BITS, &bp.bits))
+            {
+                fprintf(stderr, "Predictor size must be 1-%d bits\n", MAX_BP_BITS);
+                print_help_and_exit();
+            }
+            break;
+        case 'm':
+            if (!parse_int(optarg, 0, MAX_BP_PENALTY, &bp.penalty))
+            {
+                fprintf(stderr, "Mispredict penalty must be 0-%d cycles\n", MAX_BP_PENALTY);
+                print_help_and_exit();
+            }
+            break;
         case 'i':
             inFile = fopen(optarg, "r");
             if (inFile == NULL)
@@ -77,6 +169,31 @@ int main(int argc, char* argv[]) {
                 print_help_and_exit();
             }
             break;
+        case 's':
+            stall_report = true;
+            break;
+        case 'T':
+            load_threads = atoi(optarg);
+            if (load_threads < 1)
+            {
+                fprintf(stderr, "Loader threads must be at least 1\n");
+                print_help_and_exit();
+            }
+            break;
+        case 'V':
+            golden = optarg;
+            break;
+        case 'C':
+            ckpt_path = optarg;
+            break;
+        case 'I':
+            ckpt_interval = strtoul(optarg, NULL, 0);
+            if (ckpt_interval < 1)
+            {
+                fprintf(stderr, "Checkpoint interval must be at least 1\n");
+                print_help_and_exit();
+            }
+            break;
         case 'h':
             /* Fall through */
         default:
@@ -91,24 +208,67 @@ int main(int argc, char* argv[]) {
     printf("k1: %" PRIu64 "\n", k1);
     printf("k2: %" PRIu64 "\n", k2);
     printf("F: %"  PRIu64 "\n", f);
+    for (int t = 0; t < 3; t++)
+        if ((latency[t] != DEFAULT_LATENCY) || pipelined[t])
+            printf("k%d latency: %d%s\n", t, latency[t], pipelined[t] ? " (pipelined)" : "");
+    if (bp.type != BP_NONE)
+        printf("Branch predictor: %s, %d counters, %d cycle penalty\n",
+               (bp.type == BP_GSHARE) ? "gshare" : "bimodal", 1 << bp.bits, bp.penalty);
     printf("\n");
 
+    /* Load the trace */
+    auto load_start = std::chrono::steady_clock::now();
+    if (!load_trace_parallel(inFile, load_threads, &trace))
+    {
+        fprintf(stderr, "Failed to read trace\n");
+        exit(1);
+    }
+    double load_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - load_start).count();
+    fprintf(stderr, "Loaded %zu instructions, %.1f MB in %.3f s (%.1f MB/s, %d thread%s)\n",
+            trace.rec.size(), trace.bytes / 1e6, load_s,
+            (load_s > 0) ? trace.bytes / 1e6 / load_s : 0.0, trace.threads, (trace.threads == 1) ? "" : "s");
+
     /* Setup the processor */
-    setup_proc(r, k0, k1, k2, f);
+    setup_proc(r, k0, k1, k2, f, latency, pipelined, &bp);
 
     /* Setup statistics */
     proc_stats_t stats;
     memset(&stats, 0, sizeof(proc_stats_t));
 
+    /* Stream the run against a golden output */
+    verifier_t verifier;
+    if (golden)
+    {
+        if (!verify_open(&verifier, golden))
+            exit(1);
+        verify_proc(&verifier);
+    }
+
+    /* Pick up from a checkpoint of an earlier run */
+    checkpointer_t ckpt;
+    if (ckpt_path && !checkpoint_proc(&ckpt, ckpt_path, ckpt_interval, &trace))
+        exit(1);
+
     /* Run the processor */
+    auto run_start = std::chrono::steady_clock::now();
     run_proc(&stats);
+    double run_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - run_start).count();
+    fprintf(stderr, "Simulated %lu cycles in %.3f s (%.0f cycles/s)\n",
+            stats.cycle_count, run_s, (run_s > 0) ? stats.cycle_count / run_s : 0.0);
 
     /* Finalize stats */
     complete_proc(&stats);
 
     print_statistics(&stats);
+    if (bp.type != BP_NONE)
+        print_frontend_statistics(&stats);
 
-    return 0;
+    // the report covers the cycles run, up to a verification mismatch
+    bool verified = !golden || verify_close(&verifier);
+    if (stall_report)
+        print_stall_report(&stats);
+
+    return verified ? 0 : 1;
 }
 
 void print_statistics(proc_stats_t* p_stats) {
@@ -121,3 +281,43 @@ void print_statistics(proc_stats_t* p_stats) {
 	printf("Total run time (cycles): %lu\n", p_stats->cycle_count);
 }
 
+
+
+void print_frontend_statistics(proc_stats_t* p_stats) {
+    printf("Taken branches: %lu\n", p_stats->stalls.branches_taken);
+    printf("Branch mispredictions: %lu\n", p_stats->stalls.mispredicts);
+    printf("Fetch slots lost to redirects: %lu\n", p_stats->stalls.fetch_slots_lost);
+}
+
+static double pct(unsigned long n, unsigned long d)
+{
+    return d ? 100.0 * n / d : 0.0;
+}
+
+//
+// print_stall_report
+//
+//  Top-down breakdown of where issue slots went. Dispatch slots are
+//  reported against the F per cycle offered to the RS. FU slots are
+//  units*cycles per type; wait_bus counts slots spent holding a result
+//  that lost bus arbitration, so it is a share of those slots. wait_dep
+//  and wait_fu count RS entry-cycles, reported as entries per cycle.
+//
+void print_stall_report(proc_stats_t* p_stats) {
+    stall_stats_t* s = &p_stats->stalls;
+    unsigned long cycles = p_stats->cycle_count;
+    printf("Stall breakdown:\n");
+    printf("Fetch slots lost (branch redirect): %lu\n", s->fetch_slots_lost);
+    printf("Dispatch slots lost (RS full): %lu / %lu (%.2f%%)\n",
+           s->sched_rs_full, s->sched_slots, pct(s->sched_rs_full, s->sched_slots));
+    printf("FU\tslots\tissued\tidle%%\twait_bus\tbus%%\twait_dep\t/cycle\twait_fu\t/cycle\n");
+    for (int k = 0; k < 3; k++)
+    {
+        printf("k%d\t%lu\t%lu\t%.2f\t%lu\t%.2f\t%lu\t%.2f\t%lu\t%.2f\n", k,
+               s->fu_slots[k], s->issued[k],
+               pct(s->fu_slots[k] - std::min(s->issued[k], s->fu_slots[k]), s->fu_slots[k]),
+               s->wait_bus[k], pct(s->wait_bus[k], s->fu_slots[k]),
+               s->wait_dep[k], cycles ? (double)s->wait_dep[k] / cycles : 0.0,
+               s->wait_fu[k], cycles ? (double)s->wait_fu[k] / cycles : 0.0);
+    }
+}
@@ -0,0 +1,42 @@
+#!/bin/sh
+#
+# rowcheck.sh
+#
+#  Runs procsim with non-default FU timing and checks that the table has
+#  exactly one row per trace instruction, in tag order: a result may only
+#  retire its RS entry in the cycle it is on the bus.
+#
+#  usage: rowcheck.sh [traces...]
+#
+abs() { case $1 in /*) echo $1 ;; *) echo $PWD/$1 ;; esac; }
+PROCSIM=$(abs ${PROCSIM:-./procsim})
+[ $# -gt 0 ] || set -- traces/gccsmall.trace traces/gcc.100k.trace
+TMP=/tmp/procsim.rows.$$
+mkdir -p $TMP
+trap 'rm -rf $TMP' EXIT
+
+CONFIGS='-J3
+-J20
+-J2 -L3 -p0 -p2 -b gshare
+-r4 -j2 -k2 -l2 -f8 -K5 -L7 -p1'
+
+fail=0
+for t in "$@"; do
+    tr=$(abs $t)
+    want=$(grep -c '' $tr)
+    echo "$CONFIGS" | {
+        bad=0
+        while read -r opts; do
+            got=$(cd $TMP && $PROCSIM $opts -T 1 -i $tr 2>/dev/null |
+                  sed -n '/^INST/,/^Processor stats:/p' | sed '1d;$d' |
+                  awk -F'\t' '$1 != NR { bad = 1 } END { print bad ? -1 : NR }')
+            if [ "$got" != "$want" ]; then
+                echo "MISMATCH $(basename $t) $opts: $got rows in order, $want instructions"
+                bad=1
+            fi
+        done
+        exit $bad
+    } || fail=1
+done
+[ $fail = 0 ] && echo "rowcheck: one row per instruction"
+exit $fail
@@ -0,0 +1,563 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <exception>
+#include <chrono>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+#include <csignal>
+#include <unistd.h>
+#include <getopt.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "procsim.hpp"
+#include "trace.hpp"
+
+#define DEFAULT_SOCKET  "/tmp/procsim.sock"
+#define MAX_WORKERS     256
+#define MAX_LINE        4096
+#define MAX_JOB_WIDTH   1024    // r, k0-k2 and f
+#define MAX_JOB_LATENCY MAX_LATENCY // FU latency and mispredict penalty, in cycles
+
+// Traces by id, loaded once before the workers are forked so every
+// worker shares them copy-on-write
+std::map<std::string, trace_t> traces;
+trace_t* cur_trace = NULL;
+
+static volatile sig_atomic_t stopping = 0;
+
+// One simulation job, parsed from a request line
+typedef struct _job_t
+{
+    std::string id;
+    std::string trace;
+    uint64_t r  = DEFAULT_R;
+    uint64_t k0 = DEFAULT_K0;
+    uint64_t k1 = DEFAULT_K1;
+    uint64_t k2 = DEFAULT_K2;
+    uint64_t f  = DEFAULT_F;
+    int  latency[3]   = {DEFAULT_LATENCY, DEFAULT_LATENCY, DEFAULT_LATENCY};
+    bool pipelined[3] = {false, false, false};
+    bpred_t bp;
+} job_t;
+
+void print_help_and_exit(void) {
+    printf("procsim_server [OPTIONS] traces/file.trace...\n");
+    printf("  -S path\tListen on a Unix domain socket (default %s)\n", DEFAULT_SOCKET);
+    printf("  -P port\tListen on 127.0.0.1:port instead\n");
+    printf("  -w n\t\tWorker processes, jobs run at once (default: all cores)\n");
+    printf("  -T n\t\tTrace loader threads (default: all cores, 1 = serial)\n");
+    printf("  -h\t\tThis helpful output\n");
+    printf("\n");
+    printf("Requests are one JSON object per line, e.g.\n");
+    printf("  {\"id\":\"1\",\"trace\":\"gcc.100k\",\"r\":8,\"k0\":1,\"k1\":2,\"k2\":3,\"f\":4,\n");
+    printf("   \"latency\":[1,1,1],\"pipelined\":[0,0,0],\"bp\":\"gshare\",\"bp_bits\":12,\"bp_penalty\":3}\n");
+    printf("Only \"trace\" is required; the trace id is its file name without .trace.\n");
+    printf("Each reply is one JSON object per line with the run's statistics.\n");
+    exit(0);
+}
+
+//
+// read_instruction
+//
+//  returns true if an instruction was read successfully. Records come
+//  from the trace of the job being run.
+//
+bool read_instruction(proc_inst_t* p_inst)
+{
+    if (p_inst == NULL)
+    {
+        fprintf(stderr, "Fetch requires a valid pointer to populate\n");
+        return false;
+    }
+
+    return fill_instruction(cur_trace, p_inst);
+}
+
+static std::string trace_id(const char* path)
+{
+    std::string id = strrchr(path, '/') ? strrchr(path, '/') + 1 : path;
+    if ((id.size() > 6) && (id.compare(id.size() - 6, 6, ".trace") == 0))
+        id.resize(id.size() - 6);
+    return id;
+}
+
+static std::string json_str(const std::string& s)
+{
+    std::string out = "\"";
+    for (char c : s)
+    {
+        if ((c == '"') || (c == '\\'))
+            out += '\\';
+        if ((unsigned char)c < 0x20)
+            continue;
+        out += c;
+    }
+    return out + "\"";
+}
+
+static std::string json_error(const std::string& id, const std::string& msg)
+{
+    return "{\"ok\":false,\"id\":" + json_str(id) + ",\"error\":" + json_str(msg) + "}\n";
+}
+
+//
+// parse_job
+//
+//  Reads a flat JSON object of string, integer and integer-array values.
+//  False with *err set on malformed input, unknown keys or values out of
+//  the range the command line accepts.
+//
+static bool parse_job(const char* s, job_t* job, std::string* err)
+{
+    const char* p = s;
+    auto ws = [&]() { while (*p == ' ' || *p == '\t' || *p == '\r') p++; };
+    auto str = [&](std::string* out) {
+        if (*p != '"')
+            return false;
+        for (p++; *p && (*p != '"'); p++)
+        {
+            if ((*p == '\\') && p[1])
+                p++;
+            out->push_back(*p);
+        }
+        if (*p != '"')
+            return false;
+        p++;
+        return true;
+    };
+    auto num = [&](long* out) {
+        char* end;
+        errno = 0;
+        *out = strtol(p, &end, 10);
+        if ((end == p) || errno)
+            return false;
+        p = end;
+        return true;
+    };
+
+    ws();
+    if (*p++ != '{')
+        return (*err = "expected a JSON object", false);
+    ws();
+    if (*p == '}')
+        p++;
+    else for (;;)
+    {
+        std::string key;
+        std::string sval;
+        std::vector<long> vals;
+        bool is_str = false;
+        ws();
+        if (!str(&key))
+            return (*err = "expected a key", false);
+        ws();
+        if (*p++ != ':')
+            return (*err = "expected ':' after " + key, false);
+        ws();
+        if (*p == '"')
+        {
+            if (!str(&sval))
+                return (*err = "unterminated string for " + key, false);
+            is_str = true;
+        }
+        else if (*p == '[')
+        {
+            p++;
+            ws();
+            while (*p != ']')
+            {
+                long v;
+                if (!num(&v))
+                    return (*err = "expected integers in " + key, false);
+                vals.push_back(v);
+                ws();
+                if (*p == ',')
+                    p++;
+                ws();
+            }
+            p++;
+        }
+        else
+        {
+            long v;
+            if (!num(&v))
+                return (*err = "expected a value for " + key, false);
+            vals.push_back(v);
+        }
+
+        long v = vals.empty() ? 0 : vals[0];
+        bool scalar = !is_str && (vals.size() == 1);
+        if (key == "id")
+            job->id = is_str ? sval : std::to_string(v);
+        else if (key == "trace" && is_str)
+            job->trace = sval;
+        else if (key == "bp" && is_str)
+        {
+            if (sval == "none")
+                job->bp.type = BP_NONE;
+            else if (sval == "bimodal")
+                job->bp.type = BP_BIMODAL;
+            else if (sval == "gshare")
+                job->bp.type = BP_GSHARE;
+            else
+                return (*err = "unknown branch predictor " + sval, false);
+        }
+        else if (scalar && (key == "r" || key == "k0" || key == "k1" || key == "k2" || key == "f"))
+        {
+            if ((v < 1) || (v > MAX_JOB_WIDTH))
+                return (*err = key + " must be 1-" + std::to_string(MAX_JOB_WIDTH), false);
+            uint64_t* field[] = {&job->r, &job->k0, &job->k1, &job->k2, &job->f};
+            const char* names[] = {"r", "k0", "k1", "k2", "f"};
+            for (int i = 0; i < 5; i++)
+                if (key == names[i])
+                    *field[i] = v;
+        }
+        else if (scalar && (key == "bp_bits"))
+        {
+            if ((v < 1) || (v > 24))
+                return (*err = "bp_bits must be 1-24", false);
+            job->bp.bits = v;
+        }
+        else if (scalar && (key == "bp_penalty"))
+        {
+            if ((v < 0) || (v > MAX_JOB_LATENCY))
+                return (*err = "bp_penalty must be 0-" + std::to_string(MAX_JOB_LATENCY), false);
+            job->bp.penalty = v;
+        }
+        else if (!is_str && (vals.size() == 3) && (key == "latency"))
+        {
+            for (int i = 0; i < 3; i++)
+            {
+                if ((vals[i] < 1) || (vals[i] > MAX_JOB_LATENCY))
+                    return (*err = "FU latency must be 1-" + std::to_string(MAX_JOB_LATENCY), false);
+                job->latency[i] = vals[i];
+            }
+        }
+        else if (!is_str && (vals.size() == 3) && (key == "pipelined"))
+        {
+            for (int i = 0; i < 3; i++)
+                job->pipelined[i] = (vals[i] != 0);
+        }
+        else
+            return (*err = "bad or unknown key " + key, false);
+
+        ws();
+        if (*p == ',')
+        {
+            p++;
+            continue;
+        }
+        if (*p++ != '}')
+            return (*err = "expected ',' or '}'", false);
+        break;
+    }
+    ws();
+    if (*p && (*p != '\n'))
+        return (*err = "trailing data after object", false);
+    if (job->trace.empty())
+        return (*err = "missing trace", false);
+    return true;
+}
+
+//
+// run_job
+//
+//  Runs one job on the warm processor. setup_proc resets the processor
+//  left by the previous job instead of reallocating it, and the trace is
+//  rewound rather than reloaded.
+//
+static std::string run_job(const char* line)
+{
+    job_t job;
+    std::string err;
+    if (!parse_job(line, &job, &err))
+        return json_error(job.id, err);
+    auto t = traces.find(job.trace);
+    if (t == traces.end())
+        return json_error(job.id, "unknown trace " + job.trace);
+
+    auto start = std::chrono::steady_clock::now();
+    cur_trace = &t->second;
+    cur_trace->pos    = 0;
+    cur_trace->at_end = false;
+
+    proc_stats_t stats;
+    memset(&stats, 0, sizeof(proc_stats_t));
+    try
+    {
+        setup_proc(job.r, job.k0, job.k1, job.k2, job.f, job.latency, job.pipelined, &job.bp);
+        run_proc(&stats);
+    }
+    catch (const std::exception& e)
+    {
+        // drop the half-built processor; the next job starts from scratch
+        complete_proc(&stats);
+        return json_error(job.id, std::string("simulation failed: ") + e.what());
+    }
+    long us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+
+    const stall_stats_t* s = &stats.stalls;
+    char buf[2048];
+    int n = snprintf(buf, sizeof(buf),
+        "{\"ok\":true,\"id\":%s,\"trace\":%s,\"cycles\":%lu,\"retired\":%lu,"
+        "\"avg_disp_size\":%f,\"max_disp_size\":%lu,\"avg_inst_fired\":%f,\"avg_inst_retired\":%f,"
+        "\"branches_taken\":%lu,\"mispredicts\":%lu,\"fetch_slots_lost\":%lu,"
+        "\"stalls\":{\"sched_slots\":%lu,\"sched_rs_full\":%lu,",
+        json_str(job.id).c_str(), json_str(job.trace).c_str(), stats.cycle_count, stats.retired_instruction,
+        stats.avg_disp_size, stats.max_disp_size, stats.avg_inst_fired, stats.avg_inst_retired,
+        s->branches_taken, s->mispredicts, s->fetch_slots_lost, s->sched_slots, s->sched_rs_full);
+    const char* names[] = {"fu_slots", "issued", "wait_dep", "wait_fu", "wait_bus"};
+    const unsigned long* cols[] = {s->fu_slots, s->issued, s->wait_dep, s->wait_fu, s->wait_bus};
+    for (int i = 0; i < 5; i++)
+        n += snprintf(buf + n, sizeof(buf) - n, "%s\"%s\":[%lu,%lu,%lu]", i ? "," : "",
+                      names[i], cols[i][0], cols[i][1], cols[i][2]);
+    snprintf(buf + n, sizeof(buf) - n, "},\"run_us\":%ld}\n", us);
+    return buf;
+}
+
+static bool write_all(int fd, const std::string& s)
+{
+    size_t off = 0;
+    while (off < s.size())
+    {
+        ssize_t n = write(fd, s.data() + off, s.size() - off);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        off += n;
+    }
+    return true;
+}
+
+//
+// serve_connection
+//
+//  Answers newline-delimited requests on one connection until the client
+//  closes it. Replies come back in request order. The connection holds
+//  its worker until then; further connections wait in the listen backlog.
+//
+static void serve_connection(int fd)
+{
+    std::string in;
+    char buf[MAX_LINE];
+    for (;;)
+    {
+        size_t nl;
+        while ((nl = in.find('\n')) != std::string::npos)
+        {
+            std::string line = in.substr(0, nl);
+            in.erase(0, nl + 1);
+            if (line.find_first_not_of(" \t\r") == std::string::npos)
+                continue;
+            if (!write_all(fd, run_job(line.c_str())))
+                return;
+        }
+        if (in.size() > MAX_LINE)
+        {
+            write_all(fd, json_error("", "request too long"));
+            return;
+        }
+        ssize_t n = read(fd, buf, sizeof(buf));
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return;
+        in.append(buf, n);
+    }
+}
+
+static void worker(int listen_fd)
+{
+    signal(SIGPIPE, SIG_IGN);
+    signal(SIGINT, SIG_DFL);
+    signal(SIGTERM, SIG_DFL);
+    for (;;)
+    {
+        int fd = accept(listen_fd, NULL, NULL);
+        if (fd < 0)
+        {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            perror("accept");
+            _exit(1);
+        }
+        serve_connection(fd);
+        close(fd);
+    }
+}
+
+static pid_t spawn_worker(int listen_fd)
+{
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        worker(listen_fd);
+        _exit(0);
+    }
+    if (pid < 0)
+        perror("fork");
+    return pid;
+}
+
+static void on_stop(int sig)
+{
+    stopping = 1;
+}
+
+static int listen_on(const char* sock_path, int port)
+{
+    int fd;
+    if (port)
+    {
+        sockaddr_in a;
+        int one = 1;
+        memset(&a, 0, sizeof(a));
+        a.sin_family      = AF_INET;
+        a.sin_port        = htons(port);
+        a.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (fd >= 0)
+            setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        if ((fd < 0) || (bind(fd, (sockaddr*)&a, sizeof(a)) != 0))
+            return -1;
+    }
+    else
+    {
+        sockaddr_un a;
+        memset(&a, 0, sizeof(a));
+        a.sun_family = AF_UNIX;
+        if (strlen(sock_path) >= sizeof(a.sun_path))
+            return -1;
+        strcpy(a.sun_path, sock_path);
+        unlink(sock_path);
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if ((fd < 0) || (bind(fd, (sockaddr*)&a, sizeof(a)) != 0))
+            return -1;
+    }
+    if (listen(fd, SOMAXCONN) != 0)
+        return -1;
+    return fd;
+}
+
+int main(int argc, char* argv[]) {
+    int opt;
+    const char* sock_path = DEFAULT_SOCKET;
+    int port = 0;
+    int workers = std::thread::hardware_concurrency();
+    int load_threads = std::thread::hardware_concurrency();
+
+    while(-1 != (opt = getopt(argc, argv, "S:P:w:T:h"))) {
+        switch(opt) {
+        case 'S':
+            sock_path = optarg;
+            break;
+        case 'P':
+            port = atoi(optarg);
+            if ((port < 1) || (port > 65535))
+            {
+                fprintf(stderr, "Port must be 1-65535\n");
+                print_help_and_exit();
+            }
+            break;
+        case 'w':
+            workers = atoi(optarg);
+            if ((workers < 1) || (workers > MAX_WORKERS))
+            {
+                fprintf(stderr, "Workers must be 1-%d\n", MAX_WORKERS);
+                print_help_and_exit();
+            }
+            break;
+        case 'T':
+            load_threads = atoi(optarg);
+            if (load_threads < 1)
+            {
+                fprintf(stderr, "Loader threads must be at least 1\n");
+                print_help_and_exit();
+            }
+            break;
+        case 'h':
+            /* Fall through */
+        default:
+            print_help_and_exit();
+            break;
+        }
+    }
+    if (optind == argc)
+        print_help_and_exit();
+    if (workers < 1)
+        workers = 1;
+    if (load_threads < 1)
+        load_threads = 1;
+
+    /* Load every trace once */
+    for (int i = optind; i < argc; i++)
+    {
+        FILE* f = fopen(argv[i], "r");
+        trace_t* t = &traces[trace_id(argv[i])];
+        if ((f == NULL) || !load_trace_parallel(f, load_threads, t))
+        {
+            fprintf(stderr, "Failed to read trace %s\n", argv[i]);
+            exit(1);
+        }
+        fclose(f);
+        fprintf(stderr, "Loaded %s: %zu instructions\n", trace_id(argv[i]).c_str(), t->rec.size());
+    }
+
+    int listen_fd = listen_on(sock_path, port);
+    if (listen_fd < 0)
+    {
+        perror(port ? "listen on 127.0.0.1" : sock_path);
+        exit(1);
+    }
+
+    /* Pre-fork the worker pool; workers that die are replaced. No
+       SA_RESTART, so a stop signal interrupts wait() */
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_stop;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    std::vector<pid_t> pids;
+    for (int i = 0; i < workers; i++)
+        pids.push_back(spawn_worker(listen_fd));
+    if (port)
+        fprintf(stderr, "Listening on 127.0.0.1:%d with %d workers\n", port, workers);
+    else
+        fprintf(stderr, "Listening on %s with %d workers\n", sock_path, workers);
+
+    while (!stopping)
+    {
+        int status;
+        pid_t pid = wait(&status);
+        if (pid < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        for (size_t i = 0; i < pids.size(); i++)
+            if ((pids[i] == pid) && !stopping)
+            {
+                fprintf(stderr, "Worker %d exited, restarting\n", (int)pid);
+                pids[i] = spawn_worker(listen_fd);
+            }
+    }
+
+    for (pid_t pid : pids)
+        if (pid > 0)
+            kill(pid, SIGTERM);
+    while (wait(NULL) > 0)
+        ;
+    close(listen_fd);
+    if (!port)
+        unlink(sock_path);
+    return 0;
+}
@@ -0,0 +1,66 @@
+#!/bin/sh
+#
+# servercheck.sh
+#
+#  Runs a mix of configurations back to back on one procsim_server worker,
+#  twice over in different orders, and checks every reply against the
+#  statistics procsim prints for the same configuration. A processor
+#  reused across jobs must give the results of a fresh one.
+#
+#  usage: servercheck.sh [traces...]
+#
+abs() { case $1 in /*) echo $1 ;; *) echo $PWD/$1 ;; esac; }
+PROCSIM=$(abs ${PROCSIM:-./procsim})
+[ $# -gt 0 ] || set -- traces/gccsmall.trace traces/gcc.100k.trace
+SOCK=/tmp/procsim.check.$$.sock
+TMP=/tmp/procsim.check.$$
+mkdir -p $TMP
+
+# procsim options | the same configuration as request fields
+CONFIGS='-r8 -j1 -k2 -l3 -f4|"r":8,"k0":1,"k1":2,"k2":3,"f":4
+|
+-r2 -f8 -b gshare -J2 -L3 -p0 -p2|"r":2,"f":8,"bp":"gshare","latency":[2,1,3],"pipelined":[1,0,1]
+-r4 -j40 -k30 -l20 -f8|"r":4,"k0":40,"k1":30,"k2":20,"f":8
+-r1 -j1 -k1 -l1 -f1 -b bimodal -t 4|"r":1,"k0":1,"k1":1,"k2":1,"f":1,"bp":"bimodal","bp_bits":4'
+
+./procsim_server -S $SOCK -w 1 -T 1 "$@" 2>/dev/null &
+SERVER=$!
+trap 'kill $SERVER 2>/dev/null; wait $SERVER 2>/dev/null; rm -rf $TMP' EXIT
+while [ ! -S $SOCK ]; do
+    kill -0 $SERVER 2>/dev/null || exit 1
+    sleep 0.1
+done
+
+# expected statistics, from a fresh procsim per configuration
+: > $TMP/reqs
+for t in "$@"; do
+    id=$(basename $t .trace)
+    tr=$(abs $t)
+    n=0
+    echo "$CONFIGS" | while IFS='|' read -r opts fields; do
+        n=$((n + 1))
+        (cd $TMP && $PROCSIM $opts -T 1 -i $tr 2>/dev/null) |
+            sed -n '/^Processor stats:/,$p' | sed -n '2,7p' > $TMP/$id.$n.expect
+        echo "$id.$n|{\"id\":\"$id.$n\",\"trace\":\"$id\"${fields:+,$fields}}" >> $TMP/reqs
+    done
+done
+
+# one connection, forwards then backwards, so every job follows another configuration
+(cat $TMP/reqs; sed -n '1!G;h;$p' $TMP/reqs) | cut -d'|' -f2 |
+    ./procsim_client -S $SOCK > $TMP/replies || exit 1
+
+fail=0
+while read -r reply; do
+    id=$(echo "$reply" | sed 's/.*"id":"\([^"]*\)".*/\1/')
+    field() { echo "$reply" | sed "s/.*\"$1\":\([0-9.]*\).*/\1/"; }
+    printf 'Total instructions: %s\nAvg Dispatch queue size: %s\nMaximum Dispatch queue size: %s\nAvg inst fired per cycle: %s\nAvg inst retired per cycle: %s\nTotal run time (cycles): %s\n' \
+        "$(field retired)" "$(field avg_disp_size)" "$(field max_disp_size)" \
+        "$(field avg_inst_fired)" "$(field avg_inst_retired)" "$(field cycles)" > $TMP/got
+    if ! cmp -s $TMP/got $TMP/$id.expect; then
+        echo "MISMATCH $id: $(grep "^$id|" $TMP/reqs | cut -d'|' -f2)"
+        diff $TMP/$id.expect $TMP/got
+        fail=1
+    fi
+done < $TMP/replies
+[ $fail = 0 ] && echo "servercheck: $(wc -l < $TMP/replies) replies match procsim"
+exit $fail
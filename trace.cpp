@@ -0,0 +1,513 @@
+#include "trace.hpp"
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <thread>
+#include <sys/stat.h>
+#include <unistd.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Bytes of zero padding kept past the end of valid data so 16-byte loads
+// never leave the buffer. NUL is neither whitespace nor a digit, so the
+// scanners below always stop on it.
+#define TRACE_PAD 16
+
+enum scan_status { SCAN_OK, SCAN_FAIL, SCAN_EOF, SCAN_MORE };
+
+#if defined(__SSE2__)
+static inline unsigned ws_mask16(const char* p)
+{
+    __m128i c  = _mm_loadu_si128((const __m128i*)p);
+    __m128i sp = _mm_cmpeq_epi8(c, _mm_set1_epi8(' '));
+    __m128i t  = _mm_sub_epi8(c, _mm_set1_epi8('\t'));   // \t \n \v \f \r -> 0..4
+    __m128i ct = _mm_cmpeq_epi8(_mm_min_epu8(t, _mm_set1_epi8(4)), t);
+    return (unsigned)_mm_movemask_epi8(_mm_or_si128(sp, ct));
+}
+
+static inline unsigned digit_mask16(const char* p, bool hex)
+{
+    __m128i c  = _mm_loadu_si128((const __m128i*)p);
+    __m128i d  = _mm_sub_epi8(c, _mm_set1_epi8('0'));
+    __m128i m  = _mm_cmpeq_epi8(_mm_min_epu8(d, _mm_set1_epi8(9)), d);
+    if (hex)
+    {
+        __m128i a = _mm_sub_epi8(_mm_or_si128(c, _mm_set1_epi8(0x20)), _mm_set1_epi8('a'));
+        m = _mm_or_si128(m, _mm_cmpeq_epi8(_mm_min_epu8(a, _mm_set1_epi8(5)), a));
+    }
+    return (unsigned)_mm_movemask_epi8(m);
+}
+#endif
+
+static inline bool is_ws(char c)
+{
+    return (c == ' ') || ((unsigned char)(c - '\t') <= 4);
+}
+
+static inline int digit_val(char c, bool hex)
+{
+    if ((unsigned char)(c - '0') <= 9)
+        return c - '0';
+    if (hex && ((unsigned char)((c | 0x20) - 'a') <= 5))
+        return (c | 0x20) - 'a' + 10;
+    return -1;
+}
+
+// Advance past whitespace, 16 bytes per step where available
+static inline const char* skip_ws(const char* p)
+{
+#if defined(__SSE2__)
+    unsigned m;
+    while ((m = ~ws_mask16(p) & 0xFFFF) == 0)
+        p += 16;
+    return p + __builtin_ctz(m);
+#else
+    while (is_ws(*p))
+        p++;
+    return p;
+#endif
+}
+
+// Advance past the digit run starting at p
+static inline const char* skip_digits(const char* p, bool hex)
+{
+#if defined(__SSE2__)
+    unsigned m;
+    while ((m = ~digit_mask16(p, hex) & 0xFFFF) == 0)
+        p += 16;
+    return p + __builtin_ctz(m);
+#else
+    while (digit_val(*p, hex) >= 0)
+        p++;
+    return p;
+#endif
+}
+
+//
+// scan_int
+//
+//  Mirrors one glibc %x / %d conversion: leading whitespace, optional sign,
+//  optional 0x for hex, then digits converted with strtoul/strtol clamping.
+//  On failure *pp still advances past whatever fscanf would have consumed.
+//
+static scan_status scan_int(const char** pp, const char* end, bool eof, bool hex, int64_t* out)
+{
+    const char* p = skip_ws(*pp);
+    if (p >= end)
+    {
+        *pp = end;
+        return eof ? SCAN_EOF : SCAN_MORE;
+    }
+
+    bool neg = false;
+    if ((*p == '-') || (*p == '+'))
+    {
+        neg = (*p == '-');
+        p++;
+        if (p >= end)
+        {
+            *pp = p;
+            return eof ? SCAN_FAIL : SCAN_MORE;
+        }
+    }
+
+    bool     any = false;
+    uint64_t v   = 0;
+    bool     ovf = false;
+    if (hex && (*p == '0'))
+    {
+        any = true;
+        p++;
+        if ((p < end) && ((*p | 0x20) == 'x'))
+            p++;
+    }
+    const char* d = p;
+    p = skip_digits(p, hex);
+    if ((p >= end) && !eof)
+        return SCAN_MORE;
+    if ((p == d) && !any)
+    {
+        *pp = p;
+        return SCAN_FAIL;
+    }
+    unsigned base = hex ? 16 : 10;
+    for (; d < p; d++)
+    {
+        uint64_t nv = v * base + digit_val(*d, hex);
+        ovf |= (nv / base != v);
+        v = nv;
+    }
+
+    if (hex)
+    {
+        // %x stores via strtoul: overflow saturates, '-' negates modulo 2^64
+        if (ovf)
+            v = ULONG_MAX;
+        else if (neg)
+            v = -v;
+    }
+    else
+    {
+        // %d stores via strtol: clamp to the long range, then narrow to int
+        if (!neg && (ovf || (v > (uint64_t)LONG_MAX)))
+            v = (uint64_t)LONG_MAX;
+        else if (neg && (ovf || (v > (uint64_t)LONG_MAX + 1)))
+            v = (uint64_t)LONG_MIN;
+        else if (neg)
+            v = -v;
+    }
+    *out = (int64_t)v;
+    *pp  = p;
+    return SCAN_OK;
+}
+
+//
+// scan_rec
+//
+//  Parses one record starting at *pp. Returns false when the buffer ends
+//  mid-record and more input is available; *pp is then left untouched.
+//
+static bool scan_rec(const char** pp, const char* end, bool eof, trace_rec_t* r)
+{
+    const char* p = *pp;
+    int64_t v[5];
+    int n;
+    scan_status st = SCAN_OK;
+    for (n = 0; n < 5; n++)
+    {
+        st = scan_int(&p, end, eof, n == 0, &v[n]);
+        if (st == SCAN_MORE)
+            return false;
+        if (st != SCAN_OK)
+            break;
+    }
+    if (n == 5)
+    {
+        // trailing "\n" directive eats any whitespace run
+        p = skip_ws(p);
+        if ((p >= end) && !eof)
+            return false;
+        if (p > end)
+            p = end;    // ran on into the next chunk's whitespace
+    }
+
+    memset(r, 0, sizeof(*r));
+    if (n > 0) r->instruction_address = (uint32_t)v[0];
+    if (n > 1) r->op_code    = (int32_t)v[1];
+    if (n > 2) r->dest_reg   = (int32_t)v[2];
+    if (n > 3) r->src_reg[0] = (int32_t)v[3];
+    if (n > 4) r->src_reg[1] = (int32_t)v[4];
+    r->ret = ((n == 0) && (st == SCAN_EOF)) ? -1 : n;
+    *pp = p;
+    return true;
+}
+
+//
+// scan_bin_rec
+//
+//  Unpacks one binary record; false if fewer than a full record remain.
+//
+static bool scan_bin_rec(const char** pp, const char* end, trace_rec_t* r)
+{
+    const unsigned char* p = (const unsigned char*)*pp;
+    if (end - *pp < TRACE_BIN_REC_SIZE)
+        return false;
+    int32_t v[5];
+    for (int n = 0; n < 5; n++, p += 4)
+        v[n] = (int32_t)((uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24));
+    r->instruction_address = (uint32_t)v[0];
+    r->op_code    = v[1];
+    r->dest_reg   = v[2];
+    r->src_reg[0] = v[3];
+    r->src_reg[1] = v[4];
+    r->ret = 5;
+    *pp = (const char*)p;
+    return true;
+}
+
+//
+// load_trace
+//
+//  Reads the whole trace in TRACE_BLOCK_SIZE blocks and tokenizes it into
+//  t->rec, one entry per read_instruction call, until the input stops
+//  advancing (EOF or a token fscanf could never get past). Input that
+//  starts with TRACE_BIN_MAGIC is read as binary records instead; a
+//  trailing partial record is dropped.
+//
+bool load_trace(FILE* f, trace_t* t)
+{
+    struct stat st;
+    if ((fstat(fileno(f), &st) == 0) && S_ISREG(st.st_mode))
+        t->rec.reserve(st.st_size / 10 + 1);  // shortest line is "0 0 0 0 0\n"
+
+    std::vector<char> buf(TRACE_BLOCK_SIZE + TRACE_PAD, 0);
+    size_t len = 0;
+    bool   eof = false;
+    int    bin = -1;   // unknown until the first block is in
+    t->rec.clear();
+    t->pos     = 0;
+    t->at_end  = false;
+    t->bytes   = 0;
+    t->threads = 1;
+
+    while (true)
+    {
+        if (!eof)
+        {
+            size_t got = fread(&buf[len], 1, buf.size() - TRACE_PAD - len, f);
+            len += got;
+            eof  = (got == 0) || feof(f);
+            memset(&buf[len], 0, TRACE_PAD);
+            if (ferror(f))
+                return false;
+        }
+
+        const char* p   = &buf[0];
+        const char* end = p + len;
+        const char* prev;
+        trace_rec_t r;
+        if ((bin == -1) && ((len >= 8) || eof))
+        {
+            bin = (len >= 8) && !memcmp(p, TRACE_BIN_MAGIC, 8);
+            if (bin)
+                p += 8;
+        }
+        if (bin == 1)
+        {
+            while (scan_bin_rec(&p, end, &r))
+                t->rec.push_back(r);
+            if (eof)
+            {
+                t->end_ret = -1;
+                t->bytes  += len;
+                return true;
+            }
+        }
+        while ((bin == 0) && (prev = p, scan_rec(&p, end, eof, &r)))
+        {
+            if (p == prev)
+            {
+                // fscanf makes no progress from here (EOF or a token no
+                // conversion accepts), so every later call repeats this
+                t->end_ret = r.ret;
+                t->bytes  += p - &buf[0];
+                return true;
+            }
+            t->rec.push_back(r);
+        }
+
+        // keep the partial record and refill behind it
+        size_t used = p - &buf[0];
+        t->bytes += used;
+        memmove(&buf[0], p, len - used);
+        len -= used;
+        if (len + TRACE_PAD >= buf.size())
+            buf.resize(2 * buf.size());
+    }
+}
+
+//
+// next_trace_rec
+//
+//  Hands out records in order; past the end it repeats the terminal
+//  result. Returns false once the loaded records are exhausted.
+//
+bool next_trace_rec(trace_t* t, trace_rec_t* r)
+{
+    if (t->pos < t->rec.size())
+    {
+        *r = t->rec[t->pos++];
+        return true;
+    }
+    memset(r, 0, sizeof(*r));
+    r->ret = t->end_ret;
+    t->at_end = true;
+    return false;
+}
+
+typedef struct _trace_chunk_t
+{
+    const char* begin;
+    const char* end;
+    std::vector<trace_rec_t> rec;
+    bool        clean;  // only whole records, ending exactly at `end`
+} trace_chunk_t;
+
+// Parse one newline-aligned chunk as if its end were EOF
+static void parse_chunk(trace_chunk_t* c)
+{
+    const char* p = c->begin;
+    const char* prev;
+    trace_rec_t r;
+    c->rec.reserve((c->end - c->begin) / 16 + 1);
+    while ((prev = p, scan_rec(&p, c->end, true, &r)) && (p != prev))
+    {
+        if (r.ret != 5)
+            break;
+        c->rec.push_back(r);
+    }
+    c->clean = (p == prev) && (r.ret == -1);
+}
+
+static void parse_bin_range(const char* p, size_t n, trace_rec_t* out)
+{
+    for (size_t i = 0; i < n; i++)
+        scan_bin_rec(&p, p + TRACE_BIN_REC_SIZE, &out[i]);
+}
+
+static void pread_range(int fd, char* dst, size_t len, off_t off, char* ok)
+{
+    while (len > 0)
+    {
+        ssize_t got = pread(fd, dst, len, off);
+        if (got <= 0)
+        {
+            *ok = false;
+            return;
+        }
+        dst += got;
+        off += got;
+        len -= got;
+    }
+}
+
+//
+// load_trace_parallel
+//
+//  Reads a regular file with `threads` concurrent preads, splits it at
+//  newline boundaries and tokenizes the chunks in parallel. Records are
+//  copied to their chunk's prefix-sum offset, so t->rec (and with it the
+//  tag_ctr numbering in fetch) matches load_trace exactly. From the first
+//  chunk holding a malformed or line-spanning record onwards the input is
+//  parsed serially, keeping fscanf's stream semantics. Pipes and
+//  threads <= 1 go through load_trace.
+//
+bool load_trace_parallel(FILE* f, int threads, trace_t* t)
+{
+    struct stat st;
+    long start = ftell(f);
+    if ((threads <= 1) || (start < 0) || (fstat(fileno(f), &st) != 0) || !S_ISREG(st.st_mode))
+        return load_trace(f, t);
+
+    size_t size = st.st_size - start;
+    std::vector<char> buf(size + TRACE_PAD, 0);
+    t->rec.clear();
+    t->pos     = 0;
+    t->at_end  = false;
+    t->bytes   = size;
+    t->threads = 1;
+
+    // read
+    bool ok = true;
+    std::vector<std::thread> workers;
+    std::vector<char> read_ok(threads, 1);
+    size_t span = (size + threads - 1) / threads;
+    for (int i = 0; i < threads; i++)
+    {
+        size_t off = std::min(size, i * span);
+        size_t len = std::min(size - off, span);
+        workers.push_back(std::thread(pread_range, fileno(f), &buf[off], len, (off_t)(start + off), &read_ok[i]));
+    }
+    for (int i = 0; i < threads; i++)
+    {
+        workers[i].join();
+        ok &= (read_ok[i] != 0);
+    }
+    workers.clear();
+    if (!ok)
+        return false;
+    fseek(f, 0, SEEK_END);
+
+    const char* base = &buf[0];
+    const char* end  = base + size;
+
+    if ((size >= 8) && !memcmp(base, TRACE_BIN_MAGIC, 8))
+    {
+        size_t n = (size - 8) / TRACE_BIN_REC_SIZE;
+        size_t per = (n + threads - 1) / threads;
+        t->rec.resize(n);
+        for (int i = 0; i < threads; i++)
+        {
+            size_t first = std::min(n, i * per);
+            size_t cnt   = std::min(n - first, per);
+            workers.push_back(std::thread(parse_bin_range, base + 8 + first * TRACE_BIN_REC_SIZE, cnt, t->rec.data() + first));
+        }
+        for (size_t i = 0; i < workers.size(); i++)
+            workers[i].join();
+        t->end_ret = -1;
+        t->threads = (int)std::max<size_t>(1, std::min<size_t>(threads, n));
+        return true;
+    }
+
+    // split at newlines; a few chunks per thread evens out the work
+    std::vector<trace_chunk_t> chunks;
+    size_t nchunks = std::max<size_t>(1, std::min<size_t>(4 * threads, size / TRACE_BLOCK_SIZE));
+    const char* p = base;
+    for (size_t i = 1; (i <= nchunks) && (p < end); i++)
+    {
+        const char* e = (i == nchunks) ? end : base + i * (size / nchunks);
+        if (e < p)
+            e = p;
+        const char* nl = (const char*)memchr(e, '\n', end - e);
+        e = nl ? nl + 1 : end;
+        trace_chunk_t c;
+        c.begin = p;
+        c.end   = e;
+        chunks.push_back(c);
+        p = e;
+    }
+
+    // tokenize, one thread per chunk in rounds of `threads`
+    for (size_t i = 0; i < chunks.size(); i += threads)
+    {
+        for (size_t j = i; (j < i + threads) && (j < chunks.size()); j++)
+            workers.push_back(std::thread(parse_chunk, &chunks[j]));
+        for (size_t j = 0; j < workers.size(); j++)
+            workers[j].join();
+        workers.clear();
+    }
+
+    // place each clean chunk at its prefix-sum offset
+    size_t total = 0;
+    size_t k;
+    std::vector<size_t> offset(chunks.size());
+    for (k = 0; (k < chunks.size()) && chunks[k].clean; k++)
+    {
+        offset[k] = total;
+        total += chunks[k].rec.size();
+    }
+    t->rec.resize(total);
+    for (size_t i = 0; i < k; i += threads)
+    {
+        for (size_t j = i; (j < i + threads) && (j < k); j++)
+            workers.push_back(std::thread([&chunks, t, &offset, j]() {
+                std::copy(chunks[j].rec.begin(), chunks[j].rec.end(), t->rec.begin() + offset[j]);
+                std::vector<trace_rec_t>().swap(chunks[j].rec);
+            }));
+        for (size_t j = 0; j < workers.size(); j++)
+            workers[j].join();
+        workers.clear();
+    }
+
+    // serial tail from the first chunk that was not clean
+    t->end_ret = -1;
+    t->threads = (k > 0) ? (int)std::min<size_t>(threads, chunks.size()) : 1;
+    if (k < chunks.size())
+    {
+        // the previous record's trailing "\n" directive ate this whitespace
+        const char* q = (k > 0) ? std::min(skip_ws(chunks[k].begin), end) : chunks[k].begin;
+        const char* prev;
+        trace_rec_t r;
+        while (prev = q, scan_rec(&q, end, true, &r))
+        {
+            if (q == prev)
+            {
+                t->end_ret = r.ret;
+                break;
+            }
+            t->rec.push_back(r);
+        }
+    }
+    return true;
+}
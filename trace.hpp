@@ -0,0 +1,54 @@
+#ifndef TRACE_HPP
+#define TRACE_HPP
+
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+#ifndef TRACE_BLOCK_SIZE
+#define TRACE_BLOCK_SIZE (1 << 20)
+#endif
+
+// Binary traces start with this 8-byte magic, followed by packed
+// little-endian records of five 32-bit fields in text-trace order
+#define TRACE_BIN_MAGIC     "PSIMTRB1"
+#define TRACE_BIN_REC_SIZE  20
+
+// One fscanf("%x %d %d %d %d\n") call worth of trace input
+typedef struct _trace_rec_t
+{
+    uint32_t instruction_address;
+    int32_t  op_code;
+    int32_t  dest_reg;
+    int32_t  src_reg[2];
+    int32_t  ret;           // fscanf return value, 5 on success
+} trace_rec_t;
+
+typedef struct _trace_t
+{
+    std::vector<trace_rec_t> rec;   // records in read order
+    size_t   pos      = 0;          // next record handed to fetch
+    int32_t  end_ret  = -1;         // returned forever once input stops advancing
+    bool     at_end   = false;      // a record was asked for past the last one
+    uint64_t bytes    = 0;          // bytes of input consumed
+    int      threads  = 1;          // loader threads that parsed it
+} trace_t;
+
+#define TRACE_HASH_INIT 0xcbf29ce484222325ull
+
+// FNV-1a style running hash over records, so the hash of any prefix is
+// the state after its last record
+inline uint64_t trace_hash(uint64_t h, const trace_rec_t* r)
+{
+    const uint32_t f[6] = {r->instruction_address, (uint32_t)r->op_code, (uint32_t)r->dest_reg,
+                           (uint32_t)r->src_reg[0], (uint32_t)r->src_reg[1], (uint32_t)r->ret};
+    for (int i = 0; i < 6; i++)
+        h = (h ^ f[i]) * 0x100000001b3ull;
+    return h;
+}
+
+bool load_trace(FILE* f, trace_t* t);
+bool load_trace_parallel(FILE* f, int threads, trace_t* t);
+bool next_trace_rec(trace_t* t, trace_rec_t* r);
+
+#endif /* TRACE_HPP */
@@ -0,0 +1,132 @@
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+#include <cstring>
+#include <chrono>
+#include <thread>
+#include "trace.hpp"
+
+//
+// Micro-benchmark: trace parse throughput of load_trace and
+// load_trace_parallel against the original fscanf-per-line
+// read_instruction loop. All readers are also checked to hand fetch the
+// same sequence of results.
+//
+//  usage: trace_bench [-n reps] [-j threads] traces/file.trace ...
+//
+
+static bool legacy_read(FILE* f, trace_rec_t* r)
+{
+    memset(r, 0, sizeof(*r));
+    r->ret = fscanf(f, "%x %d %d %d %d\n", &r->instruction_address,
+                    &r->op_code, &r->dest_reg, &r->src_reg[0], &r->src_reg[1]);
+    return r->ret == 5;
+}
+
+static bool legacy_load(FILE* f, trace_t* t)
+{
+    trace_rec_t r;
+    long prev;
+    t->rec.clear();
+    t->pos = 0;
+    while (true)
+    {
+        prev = ftell(f);
+        legacy_read(f, &r);
+        if (ftell(f) == prev)
+        {
+            t->end_ret = r.ret;
+            t->bytes   = prev;
+            return true;
+        }
+        t->rec.push_back(r);
+    }
+}
+
+static bool same_rec(const trace_rec_t& a, const trace_rec_t& b)
+{
+    if (a.ret != b.ret)
+        return false;
+    int n = a.ret;
+    return ((n < 1) || (a.instruction_address == b.instruction_address)) &&
+           ((n < 2) || (a.op_code == b.op_code)) &&
+           ((n < 3) || (a.dest_reg == b.dest_reg)) &&
+           ((n < 4) || (a.src_reg[0] == b.src_reg[0])) &&
+           ((n < 5) || (a.src_reg[1] == b.src_reg[1]));
+}
+
+#define MODE_FSCANF   0
+#define MODE_BLOCK    1
+#define MODE_PARALLEL 2
+
+static double time_load(const char* path, int mode, int threads, int reps, trace_t* t)
+{
+    double best = 1e30;
+    for (int i = 0; i < reps; i++)
+    {
+        FILE* f = fopen(path, "r");
+        if (f == NULL)
+        {
+            fprintf(stderr, "Failed to open %s for reading\n", path);
+            exit(1);
+        }
+        auto t0 = std::chrono::steady_clock::now();
+        if (mode == MODE_FSCANF)
+            legacy_load(f, t);
+        else if (mode == MODE_BLOCK)
+            load_trace(f, t);
+        else
+            load_trace_parallel(f, threads, t);
+        auto t1 = std::chrono::steady_clock::now();
+        fclose(f);
+        double s = std::chrono::duration<double>(t1 - t0).count();
+        if (s < best)
+            best = s;
+    }
+    return best;
+}
+
+int main(int argc, char* argv[])
+{
+    int reps = 5;
+    int threads = std::max(1u, std::thread::hardware_concurrency());
+    int a = 1;
+    while ((a + 1 < argc) && (argv[a][0] == '-'))
+    {
+        if (!strcmp(argv[a], "-n"))
+            reps = atoi(argv[a + 1]);
+        else if (!strcmp(argv[a], "-j"))
+            threads = atoi(argv[a + 1]);
+        a += 2;
+    }
+    if (a >= argc)
+    {
+        printf("trace_bench [-n reps] [-j threads] traces/file.trace ...\n");
+        return 1;
+    }
+
+    int status = 0;
+    printf("TRACE\tMB\tfscanf MB/s\tblock MB/s\tparallel(%d) MB/s\tspeedup\n", threads);
+    for (; a < argc; a++)
+    {
+        trace_t old_t, new_t, par_t;
+        double old_s = time_load(argv[a], MODE_FSCANF, 1, reps, &old_t);
+        double new_s = time_load(argv[a], MODE_BLOCK, 1, reps, &new_t);
+        double par_s = time_load(argv[a], MODE_PARALLEL, threads, reps, &par_t);
+
+        bool match = (old_t.rec.size() == new_t.rec.size()) && (old_t.end_ret == new_t.end_ret) &&
+                     (old_t.rec.size() == par_t.rec.size()) && (old_t.end_ret == par_t.end_ret);
+        for (size_t i = 0; match && (i < old_t.rec.size()); i++)
+            match = same_rec(old_t.rec[i], new_t.rec[i]) && same_rec(old_t.rec[i], par_t.rec[i]);
+        if (!match)
+        {
+            fprintf(stderr, "%s: parsers disagree\n", argv[a]);
+            status = 1;
+        }
+
+        double mb = old_t.bytes / 1e6;
+        printf("%s\t%.2f\t%.1f\t\t%.1f\t\t%.1f\t\t\t%.2fx\n", argv[a], mb,
+               mb / old_s, mb / new_s, mb / par_s, old_s / par_s);
+    }
+    return status;
+}
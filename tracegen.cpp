@@ -0,0 +1,310 @@
+#include <algorithm>
+#include <cinttypes>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#include "trace.hpp"
+
+//
+// Synthetic trace generator for scaling and stress runs.
+//
+// Output is produced in fixed-size chunks, each generated from its own
+// RNG stream derived from (seed, chunk index), so a given seed yields the
+// same trace for any thread count. Every chunk starts at a fresh branch
+// target and cannot see its predecessor's registers, which adds one
+// address discontinuity per GEN_CHUNK instructions.
+//
+
+#define GEN_CHUNK   (1 << 20)
+#define GEN_HIST    256         // longest dependency distance honoured
+#define GEN_BASE    0x10000
+
+#define PAT_SEQ     0
+#define PAT_LOOP    1
+#define PAT_RANDOM  2
+
+typedef struct _gen_cfg_t
+{
+    uint64_t count    = 100000;
+    uint64_t seed     = 1;
+    int      threads  = 1;
+    bool     binary   = false;
+    double   mix[3]   = {0.5, 0.3, 0.2};    // FU type weights
+    double   dep_mean = 4.0;                // mean RAW distance (geometric)
+    int      regs     = 32;                 // architectural registers in use
+    double   unused   = 0.2;                // chance an operand is -1
+    int      pattern  = PAT_SEQ;
+    double   taken    = 0.1;                // seq: taken-branch probability
+    uint32_t wset     = 1 << 16;            // code working set in bytes
+    int      loop_len = 16;                 // loop: mean body length
+} gen_cfg_t;
+
+// splitmix64 - used both to derive chunk seeds and as the generator
+typedef struct _rng_t
+{
+    uint64_t s;
+    uint64_t next()
+    {
+        uint64_t z = (s += 0x9e3779b97f4a7c15ull);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+        return z ^ (z >> 31);
+    }
+    double   uniform()         { return (next() >> 11) * (1.0 / 9007199254740992.0); }
+    uint32_t below(uint32_t n) { return (uint32_t)(((next() >> 32) * n) >> 32); }
+} rng_t;
+
+static void print_help_and_exit(void)
+{
+    printf("tracegen [OPTIONS]\n");
+    printf("  -n N\t\tInstructions to generate (default 100000)\n");
+    printf("  -o file\tOutput file (default stdout)\n");
+    printf("  -B\t\tWrite the binary trace format\n");
+    printf("  -s seed\tRNG seed (default 1)\n");
+    printf("  -j T\t\tGenerator threads (default 1)\n");
+    printf("  -m a,b,c\tk0,k1,k2 opcode weights (default 0.5,0.3,0.2)\n");
+    printf("  -d mean\tMean dependency distance (default 4)\n");
+    printf("  -r R\t\tRegisters in use (default 32)\n");
+    printf("  -u p\t\tProbability an operand is unused (default 0.2)\n");
+    printf("  -a pat\tAddress pattern: seq, loop or random (default seq)\n");
+    printf("  -t p\t\tseq: taken-branch probability (default 0.1)\n");
+    printf("  -w bytes\tCode working set (default 65536)\n");
+    printf("  -l N\t\tloop: mean loop body length (default 16)\n");
+    printf("  -h\t\tThis helpful output\n");
+    exit(0);
+}
+
+static char* put_int(char* p, int32_t v)
+{
+    char tmp[12];
+    int  n = 0;
+    uint32_t u = (v < 0) ? -(uint32_t)v : (uint32_t)v;
+    if (v < 0)
+        *p++ = '-';
+    do { tmp[n++] = '0' + u % 10; u /= 10; } while (u);
+    while (n)
+        *p++ = tmp[--n];
+    return p;
+}
+
+static char* put_hex(char* p, uint32_t v)
+{
+    char tmp[8];
+    int  n = 0;
+    do { tmp[n++] = "0123456789abcdef"[v & 15]; v >>= 4; } while (v);
+    while (n)
+        *p++ = tmp[--n];
+    return p;
+}
+
+static char* put_le32(char* p, int32_t v)
+{
+    uint32_t u = (uint32_t)v;
+    for (int i = 0; i < 4; i++, u >>= 8)
+        *p++ = (char)(u & 0xff);
+    return p;
+}
+
+//
+// gen_chunk
+//
+//  Generates the n instructions of chunk `index` into out.
+//
+static void gen_chunk(const gen_cfg_t* c, uint64_t index, uint64_t n, std::string* out)
+{
+    rng_t seeder = {c->seed ^ (index * 0xd1b54a32d192ed03ull)};
+    rng_t rng    = {seeder.next()};
+
+    double mix_total = c->mix[0] + c->mix[1] + c->mix[2];
+    double p_dep     = (c->dep_mean > 1.0) ? 1.0 / c->dep_mean : 1.0;
+    uint32_t slots   = c->wset / 4 ? c->wset / 4 : 1;
+
+    int32_t  hist[GEN_HIST];
+    uint64_t filled = 0;
+
+    uint32_t pc        = GEN_BASE + 4 * rng.below(slots);
+    uint32_t loop_head = pc;
+    int      body_left = 0;
+    int      body_len  = 0;
+    int      iters     = 0;
+
+    out->resize(n * 48);
+    char* p = &(*out)[0];
+    for (uint64_t i = 0; i < n; i++)
+    {
+        // opcode from the mix
+        double  x  = rng.uniform() * mix_total;
+        int32_t op = (x < c->mix[0]) ? 0 : (x < c->mix[0] + c->mix[1]) ? 1 : 2;
+
+        // sources name the destination of an earlier instruction
+        int32_t src[2];
+        for (int s = 0; s < 2; s++)
+        {
+            if (rng.uniform() < c->unused)
+            {
+                src[s] = -1;
+                continue;
+            }
+            uint64_t d = 1;
+            if (p_dep < 1.0)
+                d += (uint64_t)(log(1.0 - rng.uniform()) / log(1.0 - p_dep));
+            if ((d <= filled) && (d <= GEN_HIST) && (hist[(filled - d) % GEN_HIST] != -1))
+                src[s] = hist[(filled - d) % GEN_HIST];
+            else
+                src[s] = rng.below(c->regs);
+        }
+        int32_t dest = (rng.uniform() < c->unused) ? -1 : (int32_t)rng.below(c->regs);
+        hist[filled++ % GEN_HIST] = dest;
+
+        if (c->binary)
+        {
+            p = put_le32(p, (int32_t)pc);
+            p = put_le32(p, op);
+            p = put_le32(p, dest);
+            p = put_le32(p, src[0]);
+            p = put_le32(p, src[1]);
+        }
+        else
+        {
+            p = put_hex(p, pc);   *p++ = ' ';
+            p = put_int(p, op);   *p++ = ' ';
+            p = put_int(p, dest); *p++ = ' ';
+            p = put_int(p, src[0]); *p++ = ' ';
+            p = put_int(p, src[1]); *p++ = '\n';
+        }
+
+        // next address
+        switch (c->pattern)
+        {
+        case PAT_SEQ:
+            if (rng.uniform() < c->taken)
+                pc = GEN_BASE + 4 * rng.below(slots);
+            else
+                pc += 4;
+            break;
+        case PAT_LOOP:
+            if (body_left == 0)
+            {
+                if (iters > 0)
+                {
+                    // back edge
+                    iters--;
+                    pc = loop_head;
+                    body_left = body_len;
+                    break;
+                }
+                // fall out into the next loop
+                loop_head = pc + 4;
+                body_len  = 1 + rng.below(2 * c->loop_len);
+                iters     = rng.below(2 * c->loop_len);
+                body_left = body_len;
+            }
+            body_left--;
+            pc += 4;
+            break;
+        default:
+            pc = GEN_BASE + 4 * rng.below(slots);
+            break;
+        }
+        if ((pc - GEN_BASE) >= 4 * slots)
+            pc = loop_head = GEN_BASE;
+    }
+    out->resize(p - &(*out)[0]);
+}
+
+static bool parse_mix(const char* s, double* mix)
+{
+    return (sscanf(s, "%lf,%lf,%lf", &mix[0], &mix[1], &mix[2]) == 3) &&
+           (mix[0] >= 0) && (mix[1] >= 0) && (mix[2] >= 0) &&
+           (mix[0] + mix[1] + mix[2] > 0);
+}
+
+int main(int argc, char* argv[])
+{
+    gen_cfg_t c;
+    FILE* out = stdout;
+    int opt;
+
+    while (-1 != (opt = getopt(argc, argv, "n:o:Bs:j:m:d:r:u:a:t:w:l:h"))) {
+        switch (opt) {
+        case 'n': c.count = strtoull(optarg, NULL, 0); break;
+        case 'B': c.binary = true; break;
+        case 's': c.seed = strtoull(optarg, NULL, 0); break;
+        case 'j': c.threads = atoi(optarg); break;
+        case 'd': c.dep_mean = atof(optarg); break;
+        case 'r': c.regs = atoi(optarg); break;
+        case 'u': c.unused = atof(optarg); break;
+        case 't': c.taken = atof(optarg); break;
+        case 'w': c.wset = strtoul(optarg, NULL, 0); break;
+        case 'l': c.loop_len = atoi(optarg); break;
+        case 'm':
+            if (!parse_mix(optarg, c.mix))
+            {
+                fprintf(stderr, "Bad opcode mix %s\n", optarg);
+                print_help_and_exit();
+            }
+            break;
+        case 'a':
+            if (!strcmp(optarg, "seq"))         c.pattern = PAT_SEQ;
+            else if (!strcmp(optarg, "loop"))   c.pattern = PAT_LOOP;
+            else if (!strcmp(optarg, "random")) c.pattern = PAT_RANDOM;
+            else
+            {
+                fprintf(stderr, "Unknown address pattern %s\n", optarg);
+                print_help_and_exit();
+            }
+            break;
+        case 'o':
+            out = fopen(optarg, "wb");
+            if (out == NULL)
+            {
+                fprintf(stderr, "Failed to open %s for writing\n", optarg);
+                exit(1);
+            }
+            break;
+        case 'h':
+            /* Fall through */
+        default:
+            print_help_and_exit();
+            break;
+        }
+    }
+    if ((c.threads < 1) || (c.regs < 1) || (c.loop_len < 1))
+        print_help_and_exit();
+
+    if (c.binary)
+        fwrite(TRACE_BIN_MAGIC, 1, 8, out);
+
+    // Generate a round of chunks in parallel, then write them in order
+    uint64_t chunks = (c.count + GEN_CHUNK - 1) / GEN_CHUNK;
+    std::vector<std::string> buf(c.threads);
+    for (uint64_t base = 0; base < chunks; base += c.threads)
+    {
+        std::vector<std::thread> workers;
+        int round = (int)std::min<uint64_t>(c.threads, chunks - base);
+        for (int t = 0; t < round; t++)
+        {
+            uint64_t idx = base + t;
+            uint64_t n   = std::min<uint64_t>(GEN_CHUNK, c.count - idx * GEN_CHUNK);
+            workers.push_back(std::thread(gen_chunk, &c, idx, n, &buf[t]));
+        }
+        for (int t = 0; t < round; t++)
+        {
+            workers[t].join();
+            if (fwrite(buf[t].data(), 1, buf[t].size(), out) != buf[t].size())
+            {
+                fprintf(stderr, "Write failed\n");
+                exit(1);
+            }
+        }
+    }
+
+    if (out != stdout)
+        fclose(out);
+    return 0;
+}
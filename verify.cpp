@@ -0,0 +1,127 @@
+#include "verify.hpp"
+#include <cstdlib>
+#include <cstring>
+
+#define VERIFY_LINE_MAX 256
+
+static void print_row(const char* label, const int* row)
+{
+    fprintf(stderr, "  %s", label);
+    for (int i = 0; i < VERIFY_FIELDS; i++)
+        fprintf(stderr, "%s%d", i ? "\t" : "", row[i]);
+    fprintf(stderr, "\n");
+}
+
+static void report(verifier_t* v, const char* what, const int* expected, const int* got)
+{
+    fprintf(stderr, "verify: %s at row %lu (%s line %lu)\n", what, v->rows + 1, v->path, v->line);
+    unsigned long n = (v->rows < VERIFY_CONTEXT) ? v->rows : VERIFY_CONTEXT;
+    for (unsigned long i = v->rows - n; i < v->rows; i++)
+        print_row("ok:       ", v->recent[i % VERIFY_CONTEXT]);
+    if (expected)
+        print_row("expected: ", expected);
+    if (got)
+        print_row("got:      ", got);
+    v->failed = true;
+}
+
+//
+// next_golden_row
+//
+//  Reads the next table row; false once the table has ended.
+//
+static bool next_golden_row(verifier_t* v, int* row)
+{
+    char buf[VERIFY_LINE_MAX];
+    if (v->table_end || !fgets(buf, sizeof(buf), v->golden))
+    {
+        v->table_end = true;
+        return false;
+    }
+    v->line++;
+    char* p = buf;
+    char* e;
+    for (int i = 0; i < VERIFY_FIELDS; i++, p = e)
+    {
+        row[i] = strtol(p, &e, 10);
+        if (e == p)
+        {
+            // blank line or "Processor stats:" closes the table
+            v->table_end = true;
+            return false;
+        }
+    }
+    return true;
+}
+
+//
+// verify_open
+//
+//  Opens a golden output and positions it after the INST header line.
+//
+bool verify_open(verifier_t* v, const char* path)
+{
+    char buf[VERIFY_LINE_MAX];
+    v->path   = path;
+    v->golden = fopen(path, "r");
+    if (v->golden == NULL)
+    {
+        fprintf(stderr, "verify: failed to open %s\n", path);
+        return false;
+    }
+    setvbuf(v->golden, NULL, _IOFBF, 1 << 16);
+    while (fgets(buf, sizeof(buf), v->golden))
+    {
+        v->line++;
+        if (!strncmp(buf, "INST", 4))
+            return true;
+    }
+    fprintf(stderr, "verify: no INST table in %s\n", path);
+    fclose(v->golden);
+    v->golden = NULL;
+    return false;
+}
+
+//
+// verify_row
+//
+//  Compares one retired row; reports and returns false at the first
+//  difference.
+//
+bool verify_row(verifier_t* v, const int* row)
+{
+    int expected[VERIFY_FIELDS];
+    if (v->failed)
+        return false;
+    if (!next_golden_row(v, expected))
+    {
+        report(v, "extra row", NULL, row);
+        return false;
+    }
+    if (memcmp(expected, row, sizeof(expected)))
+    {
+        report(v, "mismatch", expected, row);
+        return false;
+    }
+    memcpy(v->recent[v->rows % VERIFY_CONTEXT], row, sizeof(expected));
+    v->rows++;
+    return true;
+}
+
+//
+// verify_close
+//
+//  Checks the golden table has no rows left and prints the verdict.
+//
+bool verify_close(verifier_t* v)
+{
+    int expected[VERIFY_FIELDS];
+    if (!v->failed && next_golden_row(v, expected))
+        report(v, "run ended before golden row", expected, NULL);
+    if (!v->failed)
+        fprintf(stderr, "verify: %lu rows match %s\n", v->rows, v->path);
+    if (v->golden)
+        fclose(v->golden);
+    v->golden = NULL;
+    return !v->failed;
+}
@@ -0,0 +1,26 @@
+#ifndef VERIFY_HPP
+#define VERIFY_HPP
+
+#include <cstdio>
+
+#define VERIFY_FIELDS   6   // INST FETCH DISP SCHED EXEC STATE
+#define VERIFY_CONTEXT  4   // matched rows echoed before a mismatch
+
+// Streaming comparison of retired rows against a golden output table.
+// Only the golden line under test and a few matched rows are held.
+typedef struct _verifier_t
+{
+    FILE*         golden  = NULL;
+    const char*   path    = NULL;
+    unsigned long line    = 0;      // golden line number last read
+    unsigned long rows    = 0;      // rows matched so far
+    int           recent[VERIFY_CONTEXT][VERIFY_FIELDS];
+    bool          failed  = false;
+    bool          table_end = false;
+} verifier_t;
+
+bool verify_open(verifier_t* v, const char* path);
+bool verify_row(verifier_t* v, const int* row);
+bool verify_close(verifier_t* v);
+
+#endif /* VERIFY_HPP */